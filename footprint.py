@@ -0,0 +1,194 @@
+"""
+PlatformIO post script: attributes firmware.elf symbols to subsystems, reports
+their IRAM/DRAM/flash footprint and fails the build if a budget is exceeded
+or if code reachable from the display interrupt refers to flash.
+"""
+
+from __future__ import print_function
+import re
+import subprocess
+
+Import("env")
+
+REGIONS = [
+    # name, first address, last address + 1
+    ("iram", 0x40100000, 0x40108000),
+    ("dram", 0x3FFE8000, 0x40000000),
+    ("flash", 0x40200000, 0x40300000),
+]
+
+# first matching pattern wins, demangled names are matched; global instances
+# are matched by name, their classes' patterns don't cover them
+SUBSYSTEMS = [
+    ("display", r"Display|Frame|EffectVM|EffectUpload|AnimationPlayer|TimelineEntry|TUBE_PINS|BCD_PINS|waveform|[Tt]imer1|^display$"),
+    ("time", r"ClocksBehavior|TimerBehavior|Scheduler|MessageQueue|TimeLib|makeTime|breakTime|[sS]yncProvider|MONTHS|TIMEZONE_API_URL|GEOLOCATE_API_URL"),
+    ("tls", r"BearSSL|^br_|WiFiClientSecure|X509"),
+    ("web", r"ESP8266WebServer|RequestHandler|DNSServer|HTTPClient|Updater|ImageWriter|BundleWriter|PullUpdater|ConfigBehavior|MIME_TYPE|^Update$"),
+    ("config", r"LittleFS|littlefs|^lfs_|CONFIG_|Metrics|HeapSnapshot|FlashStore|Context|^metrics$|^flashStore$|^context$"),
+    ("json", r"ArduinoJson"),
+    # the core, the SDK and whatever else has no subsystem of its own
+    ("libs", r""),
+]
+
+# bytes per subsystem and region, None is unlimited
+BUDGETS = {
+    "display": {"iram": 4096, "dram": 1024, "flash": 8192},
+    "time": {"iram": 0, "dram": 512, "flash": 16384},
+    "tls": {"iram": 0, "dram": 8192, "flash": 131072},
+    "web": {"iram": 0, "dram": 2048, "flash": 65536},
+    "config": {"iram": 0, "dram": 1024, "flash": 32768},
+    "json": {"iram": 0, "dram": 256, "flash": 32768},
+    # IRAM is what the display leaves, the rest is what the core and SDK take
+    # with some headroom: a library pulled in unnoticed goes past it
+    "libs": {"iram": 28672, "dram": 36864, "flash": 393216},
+}
+
+# debug builds get room for what they record
+DEBUG_BUDGETS = {
+    # Display::timeline, 256 entries of 12 bytes
+    "NIXIECLOCK_TIMELINE": ("display", "dram", 256 * 12),
+}
+
+# code running from the timer1 interrupt, must be in IRAM
+ISR_SYMBOLS = r"Display::(onTimer|tick|step|record)"
+
+
+def budgets_for(env):
+    defines = set(define[0] if isinstance(define, (list, tuple)) else define for define in env.get("CPPDEFINES", []))
+    budgets = {name: dict(regions) for name, regions in BUDGETS.items()}
+    for define, (name, region, size) in DEBUG_BUDGETS.items():
+        if define in defines:
+            budgets[name][region] += size
+    return budgets
+
+
+def region_of(address):
+    for name, first, last in REGIONS:
+        if first <= address < last:
+            return name
+    return None
+
+
+def subsystem_of(symbol):
+    for name, pattern in SUBSYSTEMS:
+        if re.search(pattern, symbol):
+            return name
+
+
+def read_symbols(nm, elf):
+    output = subprocess.check_output([nm, "-S", "-C", elf]).decode()
+    for line in output.splitlines():
+        # symbols without a size are skipped
+        match = re.match(r"([0-9a-f]+) ([0-9a-f]+) \w (.+)$", line)
+        if match:
+            address, size, symbol = match.groups()
+            yield int(address, 16), int(size, 16), symbol
+
+
+def read_words(objdump, elf, section):
+    """Maps addresses of a section to the 32-bit words stored there."""
+    output = subprocess.check_output([objdump, "-s", "-j", section, elf]).decode()
+    words = {}
+    for line in output.splitlines():
+        match = re.match(r" ([0-9a-f]{8}) ((?:[0-9a-f]{1,8} ?){1,4})", line)
+        if match:
+            address = int(match.group(1), 16)
+            for i, word in enumerate(match.group(2).split()):
+                if len(word) == 8:
+                    # objdump shows bytes in memory order, words are little endian
+                    words[address + i * 4] = int("".join(reversed([word[j:j + 2] for j in range(0, 8, 2)])), 16)
+    return words
+
+
+def read_references(objdump, elf, section, words):
+    """Maps functions of a section to their start address and the addresses their code refers to."""
+    output = subprocess.check_output([objdump, "-d", "-C", "-j", section, elf]).decode()
+    functions = {}
+    references = None
+    for line in output.splitlines():
+        match = re.match(r"([0-9a-f]{8}) <(.+)>:$", line)
+        if match:
+            references = []
+            functions[match.group(2)] = (int(match.group(1), 16), references)
+            continue
+        if references is None:
+            continue
+        match = re.search(r"\b(call[0-9]+|j|l32r)\s+(?:a\d+, )?([0-9a-f]{8})\b", line)
+        if match:
+            address = int(match.group(2), 16)
+            # l32r loads a literal, it's the literal value which gets used
+            references.append(words.get(address, 0) if match.group(1) == "l32r" else address)
+    return functions
+
+
+def check_isr_reachability(objdump, elf, symbols):
+    """Walks the code reachable from ISR_SYMBOLS, returns flash addresses it refers to."""
+    words = read_words(objdump, elf, ".text")
+    functions = read_references(objdump, elf, ".text", words)
+    starts = sorted((start, name) for name, (start, _) in functions.items())
+
+    def function_at(address):
+        found = None
+        for start, name in starts:
+            if start > address:
+                break
+            found = name
+        return found
+
+    names = {address: symbol for address, _, symbol in symbols}
+    pending = [name for name in functions if re.search(ISR_SYMBOLS, name)]
+    visited = set(pending)
+    errors = []
+    while pending:
+        name = pending.pop()
+        for address in functions[name][1]:
+            region = region_of(address)
+            if region == "flash":
+                errors.append("%s refers to flash at %08x %s" % (name, address, names.get(address, "")))
+            elif region == "iram":
+                callee = function_at(address)
+                if callee and callee not in visited:
+                    visited.add(callee)
+                    pending.append(callee)
+    return errors
+
+
+def report(source, target, env):
+    elf = str(source[0])
+    nm = env.subst("$CC").replace("gcc", "nm")
+    objdump = env.subst("$CC").replace("gcc", "objdump")
+
+    totals = {name: {region[0]: 0 for region in REGIONS} for name, _ in SUBSYSTEMS}
+    isr_placement = []
+    symbols = list(read_symbols(nm, elf))
+    for address, size, symbol in symbols:
+        region = region_of(address)
+        if region:
+            totals[subsystem_of(symbol)][region] += size
+        if re.search(ISR_SYMBOLS, symbol):
+            isr_placement.append((symbol, region))
+
+    budgets = budgets_for(env)
+    print("Footprint, bytes:")
+    print("%-10s %8s %8s %8s" % ("", "iram", "dram", "flash"))
+    errors = []
+    for name, _ in SUBSYSTEMS:
+        print("%-10s %8d %8d %8d" % (name, totals[name]["iram"], totals[name]["dram"], totals[name]["flash"]))
+        for region, budget in budgets[name].items():
+            if budget is not None and totals[name][region] > budget:
+                errors.append("%s %s is %d bytes, budget is %d" % (name, region, totals[name][region], budget))
+
+    print("ISR placement:")
+    for symbol, region in sorted(isr_placement):
+        print("  %-40s %s" % (symbol, region))
+        if region != "iram":
+            errors.append("%s is in %s, must be in iram" % (symbol, region))
+    errors += check_isr_reachability(objdump, elf, symbols)
+
+    for error in errors:
+        print("Footprint error: " + error)
+    if errors:
+        env.Exit(1)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report)
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef AP_CHANNEL_H
+#define AP_CHANNEL_H
+
+#include <initializer_list>
+#include <stdint.h>
+
+/*
+ * Picks the least loaded channel for the AP. Each network found adds to
+ * the score of its channel and, less so, of the channels it overlaps.
+ * Stronger networks add more. Non-overlapping 1, 6 and 11 win ties.
+ * Scan has RSSI(i) and channel(i) of the networks found, as WiFi does.
+ */
+template <typename Scan>
+uint8_t selectApChannel(Scan &scan, int8_t networksFound, uint16_t &score) {
+  const int CHANNELS_COUNT = 11;
+  // 20 MHz channels, 5 MHz apart
+  const int OVERLAP = 4;
+  uint16_t scores[CHANNELS_COUNT + 1] = {};
+  for (int8_t i = 0; i < networksFound; ++i) {
+    int rssi = scan.RSSI(i);
+    int weight = rssi < -100 ? 0 : rssi > 0 ? 100 : rssi + 100;
+    int channel = scan.channel(i);
+    int first = channel - OVERLAP > 1 ? channel - OVERLAP : 1;
+    int last = channel + OVERLAP < CHANNELS_COUNT ? channel + OVERLAP : CHANNELS_COUNT;
+    for (int c = first; c <= last; ++c) {
+      int distance = c > channel ? c - channel : channel - c;
+      scores[c] += weight * (OVERLAP + 1 - distance) / (OVERLAP + 1);
+    }
+  }
+
+  uint8_t best = 1;
+  for (uint8_t channel : {6, 11, 2, 3, 4, 5, 7, 8, 9, 10}) {
+    if (scores[channel] < scores[best]) {
+      best = channel;
+    }
+  }
+  score = scores[best];
+  return best;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+#include <stdint.h>
+#include <time.h>
+
+// as TimeLib defines them, which host builds go without
+#ifndef SECS_PER_DAY
+#define SECS_PER_MIN  ((time_t)(60UL))
+#define SECS_PER_HOUR ((time_t)(3600UL))
+#define SECS_PER_DAY  ((time_t)(SECS_PER_HOUR * 24UL))
+#endif
+
+inline bool isLeapYear(int32_t year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// month is 1-12
+inline uint8_t daysInMonth(int32_t year, uint8_t month) {
+  static const uint8_t DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return month == 2 && isLeapYear(year) ? 29 : DAYS[month - 1];
+}
+
+// days since 1970-01-01, see http://howardhinnant.github.io/date_algorithms.html
+inline int32_t daysFromCivil(int32_t year, uint8_t month, uint8_t day) {
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t yearOfEra = year - era * 400;
+  uint32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + int32_t(dayOfEra) - 719468;
+}
+
+// 0 for January 1st of the year the day since 1970-01-01 is in
+inline int16_t dayOfYear(int32_t days) {
+  // leap days only make the guess late
+  int32_t year = 1970 + days / 365;
+  while (daysFromCivil(year, 1, 1) > days) {
+    --year;
+  }
+  return days - daysFromCivil(year, 1, 1);
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Write-through layer over a filesystem for small, whole-file writes.
+ * Content identical to what's stored isn't written at all, and coalesced
+ * writes are deferred a bit, so only the last of a burst hits the flash.
+ * Keeps count of writes, bytes and (estimated) block erases per file.
+ *
+ * Storage opens files as LittleFS does, and tells the block size and
+ * millis(). Its Content is the string type files are read and written as.
+ */
+template <typename Storage>
+class FlashStore {
+  public:
+    static const uint8_t MAX_FILES = 4;
+    static const uint32_t COALESCE_MILLIS = 2000;
+
+    typedef typename Storage::File File;
+    typedef typename Storage::Content Content;
+
+    struct FileStats {
+      // in PROGMEM
+      const char *path;
+      uint32_t writes;
+      uint32_t suppressed;
+      uint32_t bytesWritten;
+      uint32_t erases;
+    };
+
+  private:
+    struct Entry {
+      FileStats stats;
+      uint32_t hash;
+      bool hashKnown;
+      bool dirty;
+      uint32_t dirtySince;
+      Content pending;
+    };
+
+    Storage storage;
+    Entry entries[MAX_FILES] = {};
+    uint8_t count = 0;
+    size_t blockSize = 0;
+
+    static uint32_t hash(const Content &content) {
+      // FNV-1a
+      uint32_t hash = 2166136261u;
+      for (char c : content) {
+        hash = (hash ^ uint8_t(c)) * 16777619u;
+      }
+      return hash;
+    }
+
+    Entry *entryFor(const char *path) {
+      for (uint8_t i = 0; i < count; ++i) {
+        if (entries[i].stats.path == path) {
+          return &entries[i];
+        }
+      }
+      if (count == MAX_FILES) {
+        return nullptr;
+      }
+      Entry &entry = entries[count++];
+      entry.stats.path = path;
+      File file = storage.open(path, "r");
+      if (file) {
+        entry.hash = hash(file.readString());
+        entry.hashKnown = true;
+        file.close();
+      }
+      return &entry;
+    }
+
+    bool commit(Entry &entry) {
+      entry.dirty = false;
+      File file = storage.open(entry.stats.path, "w");
+      if (!file) {
+        // whatever is stored now, it's not the pending content
+        entry.hashKnown = false;
+        entry.pending = Content();
+        return false;
+      }
+      size_t written = file.print(entry.pending);
+      file.close();
+      ++entry.stats.writes;
+      entry.stats.bytesWritten += written;
+      // LittleFS is copy-on-write: data blocks plus a metadata block
+      entry.stats.erases += (written + blockSize - 1) / blockSize + 1;
+      bool complete = written == entry.pending.length();
+      entry.hashKnown = complete;
+      entry.pending = Content();
+      return complete;
+    }
+
+  public:
+    explicit FlashStore(Storage storage) : storage(storage) {}
+
+    void begin() {
+      blockSize = storage.blockSize();
+    }
+
+    /*
+     * Forgets pending content and rereads what's stored, for when the
+     * filesystem was replaced under the store.
+     */
+    void reload() {
+      for (uint8_t i = 0; i < count; ++i) {
+        Entry &entry = entries[i];
+        entry.dirty = false;
+        entry.pending = Content();
+        File file = storage.open(entry.stats.path, "r");
+        entry.hashKnown = bool(file);
+        if (file) {
+          entry.hash = hash(file.readString());
+          file.close();
+        }
+      }
+    }
+
+    // opens a file for reading, writing out its pending content first
+    File open(const char *path) {
+      Entry *entry = entryFor(path);
+      if (entry && entry->dirty) {
+        commit(*entry);
+      }
+      return storage.open(path, "r");
+    }
+
+    /*
+     * Replaces content of a file. Coalesced writes happen in doLoop() a bit
+     * later and their errors aren't reported.
+     */
+    bool write(const char *path, const Content &content, bool coalesce = false) {
+      Entry *entry = entryFor(path);
+      if (!entry) {
+        File file = storage.open(path, "w");
+        return file && file.print(content) == content.length();
+      }
+      uint32_t contentHash = hash(content);
+      if (entry->hashKnown && entry->hash == contentHash) {
+        entry->dirty = false;
+        entry->pending = Content();
+        ++entry->stats.suppressed;
+        return true;
+      }
+      entry->hash = contentHash;
+      entry->hashKnown = true;
+      entry->pending = content;
+      if (!entry->dirty) {
+        entry->dirty = true;
+        entry->dirtySince = storage.millis();
+      }
+      return coalesce || commit(*entry);
+    }
+
+    void doLoop() {
+      for (uint8_t i = 0; i < count; ++i) {
+        if (entries[i].dirty && storage.millis() - entries[i].dirtySince >= COALESCE_MILLIS) {
+          commit(entries[i]);
+        }
+      }
+    }
+
+    void totals(uint32_t &writes, uint32_t &bytesWritten) const {
+      writes = bytesWritten = 0;
+      for (uint8_t i = 0; i < count; ++i) {
+        writes += entries[i].stats.writes;
+        bytesWritten += entries[i].stats.bytesWritten;
+      }
+    }
+
+    // files written so far
+    uint8_t size() const {
+      return count;
+    }
+
+    const FileStats &stats(uint8_t i) const {
+      return entries[i].stats;
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "Calendar.h"
+
+const uint8_t TUBES_COUNT = 4;
+
+/*
+ * Digits and per tube brightness shown at once.
+ */
+struct Frame {
+  // K155ID1 blanks its outputs for any BCD code above 9
+  static const uint8_t BLANK = 0x0F;
+
+  uint8_t digits[TUBES_COUNT];
+  uint8_t duty[TUBES_COUNT];
+  bool dot;
+
+  // true if the frame has these digits, all at the duty
+  bool shows(const uint8_t (&digits)[TUBES_COUNT], bool dot, uint8_t duty) const {
+    for (uint8_t i = 0; i < TUBES_COUNT; ++i) {
+      if (this->digits[i] != digits[i] || this->duty[i] != duty) {
+        return false;
+      }
+    }
+    return this->dot == dot;
+  }
+
+  void set(const uint8_t (&digits)[TUBES_COUNT], bool dot, uint8_t duty) {
+    memcpy(this->digits, digits, TUBES_COUNT);
+    memset(this->duty, duty, TUBES_COUNT);
+    this->dot = dot;
+  }
+
+  uint32_t hash() const {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint8_t i = 0; i < TUBES_COUNT; ++i) {
+      hash = (hash ^ digits[i]) * 16777619u;
+    }
+    return (hash ^ dot) * 16777619u;
+  }
+};
+
+/*
+ * HH:MM of a time, returns the dot, lit every other second. Cheaper than
+ * TimeLib's hour(), minute() and second(), each doing a breakTime().
+ */
+inline bool timeDigits(time_t time, uint8_t (&digits)[TUBES_COUNT]) {
+  uint32_t secsOfDay = time % SECS_PER_DAY;
+  uint8_t hours = secsOfDay / SECS_PER_HOUR;
+  uint8_t minutes = secsOfDay / SECS_PER_MIN % 60;
+  digits[0] = hours / 10;
+  digits[1] = hours % 10;
+  digits[2] = minutes / 10;
+  digits[3] = minutes % 10;
+  return secsOfDay & 1;
+}
+
+// right aligned, without leading zeros
+inline void numberDigits(uint16_t number, uint8_t (&digits)[TUBES_COUNT]) {
+  for (int8_t i = TUBES_COUNT - 1; i >= 0; --i) {
+    digits[i] = number || i == TUBES_COUNT - 1 ? number % 10 : Frame::BLANK;
+    number /= 10;
+  }
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_QUEUE_H
+#define MESSAGE_QUEUE_H
+
+#include <stdint.h>
+
+struct MessageStats {
+  uint32_t shown;
+  uint32_t expired;
+  uint32_t dropped;
+  // from enqueue to display
+  uint32_t maxLatencyMillis;
+};
+
+/*
+ * Numbers flashed on the tubes in between the time, e.g. a queue depth or a
+ * build number. Messages are kept in a fixed-size max-heap by priority, the
+ * older first among equal ones, so enqueueing allocates nothing. A full
+ * queue drops its lowest priority message for a higher priority one, and
+ * messages not shown within their TTL are dropped. Each message is shown
+ * for its duration, at most MAX_SHOW_MILLIS, with the time shown for
+ * GAP_MILLIS in between, so the top message never waits longer than one
+ * message and one gap.
+ */
+class MessageQueue {
+  public:
+    static constexpr uint8_t CAPACITY = 16;
+    static constexpr uint16_t MAX_VALUE = 9999;
+    static constexpr uint32_t DEFAULT_TTL_SECS = 60;
+    static constexpr uint32_t DEFAULT_SHOW_SECS = 3;
+    static constexpr uint32_t MAX_SHOW_MILLIS = 10000;
+    static constexpr uint32_t GAP_MILLIS = 2000;
+
+  private:
+    struct Message {
+      uint16_t value;
+      uint8_t priority;
+      // enqueue order, wraps around
+      uint16_t sequence;
+      uint32_t enqueuedAt;
+      uint32_t ttlMillis;
+      uint32_t showMillis;
+    };
+
+    MessageStats &stats;
+    Message heap[CAPACITY];
+    uint8_t size = 0;
+    uint16_t nextSequence = 0;
+    Message current;
+    bool showing = false;
+    bool shownAny = false;
+    uint32_t shownAt = 0;
+    uint32_t endedAt = 0;
+
+    static bool isBefore(const Message &a, const Message &b) {
+      return a.priority != b.priority ? a.priority > b.priority : int16_t(a.sequence - b.sequence) < 0;
+    }
+
+    void siftUp(uint8_t i) {
+      Message message = heap[i];
+      for (; i > 0 && isBefore(message, heap[(i - 1) / 2]); i = (i - 1) / 2) {
+        heap[i] = heap[(i - 1) / 2];
+      }
+      heap[i] = message;
+    }
+
+    void siftDown(uint8_t i) {
+      Message message = heap[i];
+      for (uint8_t child = 2 * i + 1; child < size; i = child, child = 2 * i + 1) {
+        if (child + 1 < size && isBefore(heap[child + 1], heap[child])) {
+          ++child;
+        }
+        if (!isBefore(heap[child], message)) {
+          break;
+        }
+        heap[i] = heap[child];
+      }
+      heap[i] = message;
+    }
+
+  public:
+    MessageQueue(MessageStats &stats) : stats(stats) {}
+
+    bool push(uint16_t value, uint8_t priority, uint32_t ttlMillis, uint32_t showMillis, uint32_t nowMillis) {
+      Message message = {
+        value, priority, nextSequence++, nowMillis, ttlMillis, showMillis
+      };
+      if (size < CAPACITY) {
+        heap[size] = message;
+        siftUp(size++);
+        return true;
+      }
+      // the lowest priority message is a leaf
+      uint8_t lowest = size / 2;
+      for (uint8_t i = lowest + 1; i < size; ++i) {
+        if (isBefore(heap[lowest], heap[i])) {
+          lowest = i;
+        }
+      }
+      ++stats.dropped;
+      if (!isBefore(message, heap[lowest])) {
+        return false;
+      }
+      heap[lowest] = message;
+      siftUp(lowest);
+      return true;
+    }
+
+    // the message to show now, -1 for the time
+    int16_t doLoop(uint32_t ms) {
+      if (showing) {
+        if (ms - shownAt < current.showMillis) {
+          return current.value;
+        }
+        showing = false;
+        endedAt = ms;
+      }
+      if (shownAny && ms - endedAt < GAP_MILLIS) {
+        return -1;
+      }
+      while (size) {
+        current = heap[0];
+        heap[0] = heap[--size];
+        siftDown(0);
+        uint32_t latency = ms - current.enqueuedAt;
+        if (latency >= current.ttlMillis) {
+          ++stats.expired;
+          continue;
+        }
+        showing = shownAny = true;
+        shownAt = ms;
+        ++stats.shown;
+        if (latency > stats.maxLatencyMillis) {
+          stats.maxLatencyMillis = latency;
+        }
+        return current.value;
+      }
+      return -1;
+    }
+};
+
+#endif
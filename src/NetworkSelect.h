@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NETWORK_SELECT_H
+#define NETWORK_SELECT_H
+
+#include <stdint.h>
+
+/*
+ * Picks the best known network among scan results: higher priority wins
+ * over stronger signal, the stronger one wins among equal priorities.
+ * Returns its index among the known networks or -1 if none was found, and
+ * sets scanIndex to its scan result. Known has indexOf(ssid) and networks
+ * with a priority, as KnownNetworks does; Scan has SSID(i) and RSSI(i) of
+ * the networks found, as WiFi does.
+ */
+template <typename Known, typename Scan>
+int8_t selectKnownNetwork(const Known &known, Scan &scan, int8_t networksFound, int8_t &scanIndex) {
+  int8_t best = -1;
+  scanIndex = -1;
+  for (int8_t i = 0; i < networksFound; ++i) {
+    int8_t index = known.indexOf(scan.SSID(i));
+    if (index < 0) {
+      continue;
+    }
+    if (best < 0 || known[index].priority > known[best].priority
+        || (known[index].priority == known[best].priority && scan.RSSI(i) > scan.RSSI(scanIndex))) {
+      best = index;
+      scanIndex = i;
+    }
+  }
+  return best;
+}
+
+#endif
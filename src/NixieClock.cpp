@@ -15,39 +15,2032 @@
  */
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <Crypto.h>
 #include <DNSServer.h>
 #include <ESP8266HTTPClient.h>
-#include <ESP8266HTTPUpdateServer.h>
 #include <ESP8266WebServer.h>
 #include <ESP8266WiFi.h>
 #include <LittleFS.h>
+#include <MD5Builder.h>
+#include <StreamString.h>
 #include <Ticker.h>
 #include <TimeLib.h>
+#include <Updater.h>
+#include <WiFiUdp.h>
+#include <core_esp8266_waveform.h>
+#include <flash_hal.h>
+
+#include "ApChannel.h"
+#include "FlashStore.h"
+#include "Frame.h"
+#include "MessageQueue.h"
+#include "NetworkSelect.h"
+#include "Parsers.h"
+#include "RadioPower.h"
+#include "RoamingPolicy.h"
+#include "Routes.h"
+#include "Scheduler.h"
+#include "Settings.h"
+#include "SolarBrightness.h"
+#include "SyncSchedule.h"
+#include "TimerClock.h"
+#include "TimezoneUrl.h"
+#include "WebAssets.h"
 
 const char NIXIECLOCK[] PROGMEM = "nixieclock";
 
-typedef struct { char name[9]; } ConfigKey;
-const uint8_t CONFIG_KEYS_COUNT = 4;
-const ConfigKey CONFIG_KEYS[] PROGMEM = {
-  {"ssid"}, {"ssid-psk"}, {"api-key"}, {"tz"}
-};
-const char CONFIG_FILE[] PROGMEM = "/config.cfg";
+const char CONFIG_FILE[] PROGMEM = "/config.cfg";
+const char NETWORKS_FILE[] PROGMEM = "/networks.cfg";
+// suffix of asset bundle files until the whole bundle checks out
+const char BUNDLE_SUFFIX[] PROGMEM = ".new";
+// timer and message commands, one per datagram, see authenticateCommand()
+const uint16_t COMMAND_UDP_PORT = 4210;
+const char SCHEDULE_FILE[] PROGMEM = "/schedule.cfg";
+typedef struct { char name[17]; } ScheduleAction;
+// names of Scheduler::Action values
+const ScheduleAction SCHEDULE_ACTIONS[] PROGMEM = {
+  {"animation"}, {"effect"}, {"cathode-cleaning"}, {"update-check"}
+};
+const char EFFECT_EXTENSION[] PROGMEM = ".fx";
+const char ANIMATION_EXTENSION[] PROGMEM = ".nxa";
+const char STARTUP_ANIMATION[] PROGMEM = "/startup.nxa";
+const char HOURLY_ANIMATION[] PROGMEM = "/hourly.nxa";
+
+const char MIME_TYPE_JSON[] PROGMEM = "application/json";
+const char MIME_TYPE_TEXT[] PROGMEM = "text/plain";
+
+const char GEOLOCATE_API_URL[] PROGMEM = "https://www.googleapis.com/geolocation/v1/geolocate?key=";
+
+// FlashStore's access to LittleFS
+struct LittleFsStorage {
+  typedef fs::File File;
+  typedef String Content;
+
+  File open(PGM_P path, const char *mode) {
+    return LittleFS.open(FPSTR(path), mode);
+  }
+
+  size_t blockSize() {
+    FSInfo info;
+    return LittleFS.info(info) ? info.blockSize : 4096;
+  }
+
+  uint32_t millis() const {
+    return ::millis();
+  }
+};
+FlashStore<LittleFsStorage> flashStore{LittleFsStorage()};
+
+/*
+ * Runtime counters, meant for tracking clock behavior over long runs.
+ */
+struct Metrics {
+  // extra ESP8266 current draw at 160 MHz, mA
+  static const uint16_t BOOST_CURRENT = 10;
+
+  uint32_t syncs;
+  uint32_t syncFailures;
+  // seconds the clock was off right before the last successful sync
+  int32_t displayErrorSecs;
+  RadioStats radio;
+  uint32_t boostedMillis;
+  uint32_t networkSelectionMillis;
+  uint32_t roams;
+  uint8_t apChannel;
+  uint16_t apChannelScore;
+  uint32_t tlsRequests;
+  uint32_t tlsMillis;
+  uint32_t updates;
+  uint32_t updateBytes;
+  uint32_t updateMillis;
+  uint32_t updateVerifyMillis;
+  uint32_t effectFrames;
+  uint32_t effectInstructions;
+  uint16_t effectMaxInstructions;
+  uint32_t effectPreemptions;
+  uint32_t animationFrames;
+  uint32_t animationUnderruns;
+  MessageStats messages;
+  uint32_t commandsRejected;
+  uint32_t lastSampleMillis;
+
+  void sample() {
+    lastSampleMillis = millis();
+  }
+
+  // estimated charge drawn since boot, mAh
+  float energyEstimate() const {
+    // RadioPower runs in clock mode only, the config mode AP is always awake
+    uint32_t radioMillis = radio.totalMillis();
+    uint32_t unmanagedMillis = lastSampleMillis > radioMillis ? lastSampleMillis - radioMillis : 0;
+    return radio.energyEstimate() + (float(unmanagedMillis) * RadioStats::CURRENT[RADIO_AWAKE]
+      + float(boostedMillis) * BOOST_CURRENT) / 3600000;
+  }
+
+  void tlsRequest(uint32_t startedMillis) {
+    ++tlsRequests;
+    tlsMillis += millis() - startedMillis;
+  }
+
+  void update(size_t bytes, uint32_t startedMillis, uint32_t verifyMillis) {
+    ++updates;
+    updateBytes += bytes;
+    updateMillis += millis() - startedMillis;
+    updateVerifyMillis += verifyMillis;
+  }
+
+  size_t toJson(String &jsonStr) const {
+    StaticJsonDocument<1536> jsonDoc;
+    jsonDoc[F("uptime")] = lastSampleMillis / 1000;
+    jsonDoc[F("syncs")] = syncs;
+    jsonDoc[F("sync-failures")] = syncFailures;
+    jsonDoc[F("display-error-secs")] = displayErrorSecs;
+    uint32_t flashWrites, flashBytesWritten;
+    flashStore.totals(flashWrites, flashBytesWritten);
+    jsonDoc[F("flash-writes")] = flashWrites;
+    jsonDoc[F("flash-bytes-written")] = flashBytesWritten;
+    JsonObject files = jsonDoc.createNestedObject(F("files"));
+    for (uint8_t i = 0; i < flashStore.size(); ++i) {
+      const auto &stats = flashStore.stats(i);
+      JsonObject file = files.createNestedObject(FPSTR(stats.path));
+      file[F("writes")] = stats.writes;
+      file[F("suppressed")] = stats.suppressed;
+      file[F("bytes")] = stats.bytesWritten;
+      file[F("erases")] = stats.erases;
+    }
+    jsonDoc[F("radio-modem-sleep-secs")] = radio.sleepMillis[RADIO_MODEM_SLEEP] / 1000;
+    jsonDoc[F("radio-awake-secs")] = radio.sleepMillis[RADIO_AWAKE] / 1000;
+    jsonDoc[F("radio-sync-secs")] = radio.userMillis[RADIO_SYNC] / 1000;
+    jsonDoc[F("radio-management-secs")] = radio.userMillis[RADIO_MANAGEMENT] / 1000;
+    jsonDoc[F("radio-update-secs")] = radio.userMillis[RADIO_UPDATE] / 1000;
+    jsonDoc[F("network-selection-ms")] = networkSelectionMillis;
+    jsonDoc[F("roams")] = roams;
+    jsonDoc[F("ap-channel")] = apChannel;
+    jsonDoc[F("ap-channel-score")] = apChannelScore;
+    jsonDoc[F("boosted-secs")] = boostedMillis / 1000;
+    jsonDoc[F("tls-requests")] = tlsRequests;
+    jsonDoc[F("tls-avg-ms")] = tlsRequests ? tlsMillis / tlsRequests : 0;
+    jsonDoc[F("updates")] = updates;
+    // bytes per ms is about KB per second
+    jsonDoc[F("update-kbps")] = updateMillis ? updateBytes / updateMillis : 0;
+    jsonDoc[F("update-verify-ms")] = updates ? updateVerifyMillis / updates : 0;
+    jsonDoc[F("effect-frames")] = effectFrames;
+    jsonDoc[F("effect-avg-ipf")] = effectFrames ? effectInstructions / effectFrames : 0;
+    jsonDoc[F("effect-max-ipf")] = effectMaxInstructions;
+    jsonDoc[F("effect-preemptions")] = effectPreemptions;
+    jsonDoc[F("animation-frames")] = animationFrames;
+    jsonDoc[F("animation-underruns")] = animationUnderruns;
+    jsonDoc[F("messages-shown")] = messages.shown;
+    jsonDoc[F("messages-expired")] = messages.expired;
+    jsonDoc[F("messages-dropped")] = messages.dropped;
+    jsonDoc[F("message-max-latency-ms")] = messages.maxLatencyMillis;
+    jsonDoc[F("commands-rejected")] = commandsRejected;
+    jsonDoc[F("energy-mah")] = energyEstimate();
+    jsonDoc[F("free-heap")] = ESP.getFreeHeap();
+    return serializeJson(jsonDoc, jsonStr);
+  }
+};
+Metrics metrics = {};
+
+// IN-8-2 anodes, left to right
+const uint8_t TUBE_PINS[TUBES_COUNT] = {D7, D6, D5, D0};
+// IN-3 neon dot
+const uint8_t DOT_PIN = D8;
+// K155ID1 inputs A, B, C, D
+const uint8_t BCD_PINS[] = {TX, RX, D1, D3};
+// HV boost converter gate
+const uint8_t HV_PIN = D4;
+const uint32_t HV_PWM_FREQ = 20000;
+const uint8_t HV_DUTY = 100;
+// lowest boost duty the tubes are dimmed to
+const uint8_t HV_NIGHT_DUTY = 80;
+
+// boost converter duty to go with the tubes duty SolarBrightness picked
+uint8_t hvDutyFor(uint8_t duty) {
+  return HV_NIGHT_DUTY + (HV_DUTY - HV_NIGHT_DUTY) * (duty - SolarBrightness::NIGHT_DUTY)
+    / (SolarBrightness::DAY_DUTY - SolarBrightness::NIGHT_DUTY);
+}
+
+/*
+ * A frame swap recorded by the display, when built with NIXIECLOCK_TIMELINE.
+ */
+struct TimelineEntry {
+  uint32_t micros;
+  uint32_t hash;
+  uint8_t duty[TUBES_COUNT];
+};
+
+/*
+ * Multiplexes the tubes from the timer1 interrupt. Frames are double buffered:
+ * loop() composes the back frame and the interrupt swaps it in at the start
+ * of the next scan, so a frame is never shown half updated.
+ *
+ * Everything the interrupt touches lives in IRAM/DRAM: it writes GPIO
+ * registers through masks computed in begin() rather than calling into
+ * flash, which could stall on a cache miss while the flash is being written.
+ */
+class Display {
+    // 100 Hz refresh of the whole display
+    static constexpr uint32_t SLOT_MICROS = 10000 / TUBES_COUNT;
+    // shortest interval timer1 is reprogrammed for
+    static constexpr uint32_t MIN_MICROS = 10;
+
+    Frame frames[2] = {};
+    uint32_t hashes[2] = {};
+    volatile uint8_t front = 0;
+    volatile bool swapPending = false;
+    uint8_t tube = TUBES_COUNT - 1;
+    bool anodeOn = false;
+    uint32_t onMicros = 0;
+    uint32_t deadline = 0;
+    uint32_t cyclesPerMicro = 80;
+    uint8_t hvDuty = HV_DUTY;
+    // GPOS/GPOC masks, GPIO16 has a register of its own
+    uint32_t anodeMasks[TUBES_COUNT] = {};
+    bool anodeOnGpio16[TUBES_COUNT] = {};
+    uint32_t bcdMasks[16] = {};
+    uint32_t bcdAllMask = 0;
+    uint32_t dotMask = 0;
+
+    void IRAM_ATTR setAnode(uint8_t tube, bool on) {
+      if (anodeOnGpio16[tube]) {
+        GP16O = on;
+      } else if (on) {
+        GPOS = anodeMasks[tube];
+      } else {
+        GPOC = anodeMasks[tube];
+      }
+    }
+
+#ifdef NIXIECLOCK_TIMELINE
+    static constexpr uint16_t TIMELINE_LENGTH = 256;
+    TimelineEntry timeline[TIMELINE_LENGTH];
+    volatile uint16_t timelineHead = 0;
+    volatile bool timelineWrapped = false;
+
+    void IRAM_ATTR record() {
+      TimelineEntry &entry = timeline[timelineHead];
+      entry.micros = micros();
+      entry.hash = hashes[front];
+      memcpy(entry.duty, frames[front].duty, TUBES_COUNT);
+      if (++timelineHead == TIMELINE_LENGTH) {
+        timelineHead = 0;
+        timelineWrapped = true;
+      }
+    }
+#endif
+
+    // performs the next scan step, returns microseconds till the step after
+    uint32_t IRAM_ATTR step() {
+      if (anodeOn) {
+        setAnode(tube, false);
+        anodeOn = false;
+        uint32_t offMicros = SLOT_MICROS - onMicros;
+        return offMicros < MIN_MICROS ? MIN_MICROS : offMicros;
+      }
+
+      if (++tube == TUBES_COUNT) {
+        tube = 0;
+        if (swapPending) {
+          front ^= 1;
+          swapPending = false;
+          if (frames[front].dot) {
+            GPOS = dotMask;
+          } else {
+            GPOC = dotMask;
+          }
+#ifdef NIXIECLOCK_TIMELINE
+          record();
+#endif
+        }
+      }
+
+      const Frame &frame = frames[front];
+      uint8_t digit = frame.digits[tube] & 0x0F;
+      GPOC = bcdAllMask & ~bcdMasks[digit];
+      GPOS = bcdMasks[digit];
+      onMicros = SLOT_MICROS * frame.duty[tube] / 255;
+      if (digit > 9 || onMicros < MIN_MICROS) {
+        return SLOT_MICROS;
+      }
+      setAnode(tube, true);
+      anodeOn = true;
+      return onMicros;
+    }
+
+    // timer1 is shared with analogWrite(), so the callback runs on every
+    // timer1 interrupt and has to check its own deadline
+    uint32_t IRAM_ATTR tick() {
+      uint32_t cycles = ESP.getCycleCount();
+      int32_t remaining = deadline - cycles;
+      if (remaining > int32_t(cyclesPerMicro)) {
+        return remaining / cyclesPerMicro;
+      }
+      uint32_t nextMicros = step();
+      deadline = cycles + nextMicros * cyclesPerMicro;
+      return nextMicros;
+    }
+
+    static uint32_t IRAM_ATTR onTimer();
+
+  public:
+    void begin() {
+      for (uint8_t i = 0; i < TUBES_COUNT; ++i) {
+        uint8_t pin = TUBE_PINS[i];
+        pinMode(pin, OUTPUT);
+        digitalWrite(pin, LOW);
+        anodeOnGpio16[i] = pin == 16;
+        anodeMasks[i] = pin < 16 ? bit(pin) : 0;
+      }
+      for (uint8_t digit = 0; digit < 16; ++digit) {
+        for (uint8_t i = 0; i < 4; ++i) {
+          if (bitRead(digit, i)) {
+            bcdMasks[digit] |= bit(BCD_PINS[i]);
+          }
+        }
+      }
+      for (uint8_t pin : BCD_PINS) {
+        pinMode(pin, OUTPUT);
+        bcdAllMask |= bit(pin);
+      }
+      pinMode(DOT_PIN, OUTPUT);
+      digitalWrite(DOT_PIN, LOW);
+      dotMask = bit(DOT_PIN);
+      for (Frame &frame : frames) {
+        memset(frame.digits, Frame::BLANK, TUBES_COUNT);
+      }
+
+      cyclesPerMicro = ESP.getCpuFreqMHz();
+      setTimer1Callback(onTimer);
+
+      analogWriteRange(255);
+      analogWriteFreq(HV_PWM_FREQ);
+      analogWrite(HV_PIN, HV_DUTY);
+    }
+
+    void setHvDuty(uint8_t duty) {
+      if (duty != hvDuty) {
+        hvDuty = duty;
+        analogWrite(HV_PIN, duty);
+      }
+    }
+
+    // the interrupt counts CPU cycles, so has to be told when their rate changes
+    void setCpuFrequency(uint8_t mhz) {
+      noInterrupts();
+      uint32_t cycles = ESP.getCycleCount();
+      int32_t remaining = deadline - cycles;
+      if (remaining > 0) {
+        deadline = cycles + uint32_t(remaining) / cyclesPerMicro * mhz;
+      }
+      cyclesPerMicro = mhz;
+      interrupts();
+    }
+
+    // composes and shows a frame, unless it's the one shown
+    void showDigits(const uint8_t (&digits)[TUBES_COUNT], bool dot, uint8_t duty) {
+      // once a pending swap completes, the front frame is the one that stays
+      // shown, rather than the one about to be replaced
+      Frame &back = backFrame();
+      if (frames[front].shows(digits, dot, duty)) {
+        return;
+      }
+
+      back.set(digits, dot, duty);
+      show();
+    }
+
+    // the frame being shown
+    const Frame &frontFrame() const {
+      return frames[front];
+    }
+
+    // the frame to compose, shown after the next call to show()
+    Frame &backFrame() {
+      // the previous swap must complete before the back frame can be touched
+      while (swapPending) {
+        yield();
+      }
+      return frames[front ^ 1];
+    }
+
+    void show() {
+      hashes[front ^ 1] = frames[front ^ 1].hash();
+      swapPending = true;
+    }
+
+    void showTime(time_t time, uint8_t duty = 255) {
+      uint8_t digits[TUBES_COUNT];
+      bool dot = timeDigits(time, digits);
+      showDigits(digits, dot, duty);
+    }
+
+    // right aligned, without leading zeros
+    void showNumber(uint16_t number, uint8_t duty = 255) {
+      uint8_t digits[TUBES_COUNT];
+      numberDigits(number, digits);
+      showDigits(digits, false, duty);
+    }
+
+#ifdef NIXIECLOCK_TIMELINE
+    // writes recorded swaps, oldest first, as "micros,hash,duty..." lines
+    void dumpTimeline(Print &out) {
+      uint16_t head = timelineHead;
+      uint16_t count = timelineWrapped ? TIMELINE_LENGTH : head;
+      for (uint16_t i = 0; i < count; ++i) {
+        const TimelineEntry &entry = timeline[(head + TIMELINE_LENGTH - count + i) % TIMELINE_LENGTH];
+        out.printf_P(PSTR("%u,%08x"), entry.micros, entry.hash);
+        for (uint8_t duty : entry.duty) {
+          out.printf_P(PSTR(",%u"), duty);
+        }
+        out.println();
+      }
+    }
+#endif
+};
+Display display;
+
+uint32_t IRAM_ATTR Display::onTimer() {
+  return display.tick();
+}
+
+// user assets are stored as /<name><extension>, see isAssetName()
+String assetPath(const String &name, PGM_P extension) {
+  if (!isAssetName(name.c_str())) {
+    return String();
+  }
+  return String('/') + name + FPSTR(extension);
+}
+
+#ifdef NIXIECLOCK_HEAPDUMP
+// start of the umm_malloc heap, from the linker script
+extern "C" char _heap_start[];
+
+/*
+ * A snapshot of the heap, block by block, when built with
+ * NIXIECLOCK_HEAPDUMP. umm_malloc splits the heap into 8-byte blocks, an
+ * allocation takes a run of them which starts with the numbers of the next
+ * and the previous run, the top bit of the next one marking a free run.
+ * Allocations don't record their call site, so the first word of a used
+ * run is kept as its tag: a vtable pointer names the class of an object,
+ * text is likely a String's buffer. The runs are copied before anything is
+ * sent, as sending allocates.
+ */
+class HeapSnapshot {
+  private:
+    static constexpr uint16_t BLOCK_SIZE = 8;
+    static constexpr uint16_t BLOCKNO_MASK = 0x7FFF;
+    static constexpr uint16_t FREE_MASK = 0x8000;
+#if defined(UMM_POISON_CHECK) || defined(UMM_POISON_CHECK_LITE)
+    // run header, then the allocation size and poison
+    static constexpr uint16_t DATA_OFFSET = 4 + 4 + 4;
+#else
+    static constexpr uint16_t DATA_OFFSET = 4;
+#endif
+    static constexpr uint16_t MAX_RUNS = 1024;
+
+    struct Run {
+      uint16_t block;
+      // the next run, FREE_MASK set if this one is free
+      uint16_t next;
+      uint32_t tag;
+    };
+
+    std::unique_ptr<Run[]> runs;
+    uint16_t count = 0;
+    uint16_t ownBlock = 0;
+    bool truncated = false;
+
+    static const char *blockAt(uint16_t block) {
+      return _heap_start + block * BLOCK_SIZE;
+    }
+
+    static uint16_t nextOf(uint16_t block) {
+      return *reinterpret_cast<const uint16_t*>(blockAt(block));
+    }
+
+  public:
+    void take() {
+      // leave the rest of the largest block for sending
+      uint32_t capacity = ESP.getMaxFreeBlockSize() / 2 / sizeof(Run);
+      capacity = capacity < MAX_RUNS ? capacity : MAX_RUNS;
+      runs.reset(new Run[capacity]);
+      ownBlock = (reinterpret_cast<const char*>(runs.get()) - DATA_OFFSET - _heap_start) / BLOCK_SIZE;
+      count = 0;
+      truncated = false;
+      // block 0 only heads the free list, the last block points back to it;
+      // interrupt handlers don't allocate, so the heap can't change meanwhile
+      uint16_t block = nextOf(0) & BLOCKNO_MASK;
+      for (uint16_t next = nextOf(block); next & BLOCKNO_MASK; block = next & BLOCKNO_MASK, next = nextOf(block)) {
+        if (count == capacity) {
+          truncated = true;
+          break;
+        }
+        Run &run = runs[count++];
+        run.block = block;
+        run.next = next;
+        run.tag = next & FREE_MASK ? 0 : *reinterpret_cast<const uint32_t*>(blockAt(block) + DATA_OFFSET);
+      }
+    }
+
+    // "heap,<address>,<block size>,<own block>,<truncated>", then a
+    // "<block>,<blocks>,<u|f>,<tag>" line per run, streamed in chunks
+    void send(ESP8266WebServer &webServer) {
+      webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+      webServer.send(200, FPSTR(MIME_TYPE_TEXT), String());
+      char chunk[512];
+      int length = snprintf_P(
+        chunk, sizeof chunk, PSTR("heap,%08x,%u,%u,%u\n"), reinterpret_cast<uint32_t>(_heap_start), BLOCK_SIZE, ownBlock, truncated
+      );
+      for (uint16_t i = 0; i < count; ++i) {
+        if (length > int(sizeof chunk) - 24) {
+          webServer.sendContent(chunk, length);
+          length = 0;
+        }
+        const Run &run = runs[i];
+        length += snprintf_P(
+          chunk + length, sizeof chunk - length, PSTR("%u,%u,%c,%08x\n"),
+          run.block, (run.next & BLOCKNO_MASK) - run.block, run.next & FREE_MASK ? 'f' : 'u', run.tag
+        );
+      }
+      webServer.sendContent(chunk, length);
+    }
+};
+#endif
+
+/*
+ * Runs user effects: programs for a tiny register machine which render
+ * frames. An instruction is 4 bytes, an opcode and 3 operands, of which a
+ * 16-bit immediate or jump target takes the last two. Programs are checked
+ * when loaded, so running them needs no checks but for division by zero.
+ * A frame gets at most FUEL instructions: a program which hasn't yielded by
+ * then is preempted and continues with the next frame, so no effect can
+ * hold up the loop. Falling off the end or HALT stops the effect.
+ */
+class EffectVM {
+  public:
+    enum Opcode : uint8_t {
+      OP_HALT,  // stops the effect
+      OP_LDI,   // ra = imm
+      OP_MOV,   // ra = rb
+      OP_ADD,   // ra = rb + rc
+      OP_SUB,   // ra = rb - rc
+      OP_MUL,   // ra = rb * rc
+      OP_DIV,   // ra = rb / rc
+      OP_MOD,   // ra = rb % rc
+      OP_ADDI,  // ra = rb + int8 c
+      OP_SLT,   // ra = rb < rc
+      OP_JMP,   // goes to imm
+      OP_JZ,    // goes to imm if ra is 0
+      OP_JNZ,   // goes to imm unless ra is 0
+      OP_DIGIT, // tube ra shows digit rb, blank unless 0-9
+      OP_DUTY,  // tube ra gets brightness rb, 0-255
+      OP_DOT,   // the dot is lit unless ra is 0
+      OP_FRAME, // ra = frames since the effect started
+      OP_CLOCK, // ra = local seconds of day
+      OP_YIELD, // shows the frame, continues with the next one
+      OP_WAIT,  // shows the frame, continues ra frames later
+      OPCODES_COUNT
+    };
+
+    static const uint8_t REGISTERS_COUNT = 8;
+    static const uint16_t MAX_INSTRUCTIONS = 256;
+    static const uint16_t FUEL = 200;
+    // 100 Hz, as the display refresh
+    static const uint32_t FRAME_MILLIS = 10;
+
+  private:
+    struct Instruction {
+      uint8_t op, a, b, c;
+
+      int16_t imm() const {
+        return int16_t(b | c << 8);
+      }
+    };
+
+    std::unique_ptr<Instruction[]> code;
+    uint16_t length = 0;
+    uint16_t pc = 0;
+    int32_t r[REGISTERS_COUNT];
+    uint32_t frames = 0;
+    uint32_t waitFrames = 0;
+    uint32_t frameDueMillis = 0;
+    Frame frame;
+
+    bool isValid(const Instruction &in) const {
+      const uint8_t R = REGISTERS_COUNT;
+      switch (in.op) {
+        case OP_HALT:
+        case OP_YIELD:
+          return true;
+        case OP_LDI:
+        case OP_DOT:
+        case OP_FRAME:
+        case OP_CLOCK:
+        case OP_WAIT:
+          return in.a < R;
+        case OP_MOV:
+        case OP_ADDI:
+        case OP_DIGIT:
+        case OP_DUTY:
+          return in.a < R && in.b < R;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_SLT:
+          return in.a < R && in.b < R && in.c < R;
+        case OP_JMP:
+          return uint16_t(in.imm()) < length;
+        case OP_JZ:
+        case OP_JNZ:
+          return in.a < R && uint16_t(in.imm()) < length;
+        default:
+          return false;
+      }
+    }
+
+    // returns instructions executed
+    uint16_t runFrame(uint32_t secsOfDay) {
+      if (waitFrames) {
+        --waitFrames;
+        return 0;
+      }
+      uint16_t executed = 0;
+      while (code) {
+        if (executed == FUEL) {
+          ++metrics.effectPreemptions;
+          break;
+        }
+        if (pc >= length) {
+          stop();
+          break;
+        }
+        const Instruction &in = code[pc++];
+        ++executed;
+        switch (in.op) {
+          case OP_HALT:
+            stop();
+            break;
+          case OP_LDI:
+            r[in.a] = in.imm();
+            break;
+          case OP_MOV:
+            r[in.a] = r[in.b];
+            break;
+          // signed overflow is undefined, arithmetic wraps around in unsigned
+          case OP_ADD:
+            r[in.a] = int32_t(uint32_t(r[in.b]) + uint32_t(r[in.c]));
+            break;
+          case OP_SUB:
+            r[in.a] = int32_t(uint32_t(r[in.b]) - uint32_t(r[in.c]));
+            break;
+          case OP_MUL:
+            r[in.a] = int32_t(uint32_t(r[in.b]) * uint32_t(r[in.c]));
+            break;
+          case OP_DIV:
+          case OP_MOD:
+            if (!r[in.c]) {
+              stop();
+              break;
+            }
+            // INT32_MIN / -1 overflows, it wraps around to INT32_MIN
+            if (r[in.c] == -1) {
+              r[in.a] = in.op == OP_DIV ? int32_t(0u - uint32_t(r[in.b])) : 0;
+              break;
+            }
+            r[in.a] = in.op == OP_DIV ? r[in.b] / r[in.c] : r[in.b] % r[in.c];
+            break;
+          case OP_ADDI:
+            r[in.a] = int32_t(uint32_t(r[in.b]) + uint32_t(int32_t(int8_t(in.c))));
+            break;
+          case OP_SLT:
+            r[in.a] = r[in.b] < r[in.c];
+            break;
+          case OP_JMP:
+            pc = in.imm();
+            break;
+          case OP_JZ:
+            if (!r[in.a]) {
+              pc = in.imm();
+            }
+            break;
+          case OP_JNZ:
+            if (r[in.a]) {
+              pc = in.imm();
+            }
+            break;
+          case OP_DIGIT:
+            if (uint32_t(r[in.a]) < TUBES_COUNT) {
+              frame.digits[r[in.a]] = uint32_t(r[in.b]) <= 9 ? r[in.b] : Frame::BLANK;
+            }
+            break;
+          case OP_DUTY:
+            if (uint32_t(r[in.a]) < TUBES_COUNT) {
+              frame.duty[r[in.a]] = constrain(r[in.b], 0, 255);
+            }
+            break;
+          case OP_DOT:
+            frame.dot = r[in.a];
+            break;
+          case OP_FRAME:
+            r[in.a] = frames;
+            break;
+          case OP_CLOCK:
+            r[in.a] = secsOfDay;
+            break;
+          case OP_WAIT:
+            waitFrames = r[in.a] > 0 ? r[in.a] : 0;
+            return executed;
+          case OP_YIELD:
+            return executed;
+        }
+      }
+      return executed;
+    }
+
+  public:
+    static String pathFor(const String &name) {
+      return assetPath(name, EFFECT_EXTENSION);
+    }
+
+    bool load(const String &name) {
+      stop();
+      String path = pathFor(name);
+      File file = path.length() ? LittleFS.open(path, "r") : File();
+      if (!file) {
+        return false;
+      }
+      size_t size = file.size();
+      if (!size || size % sizeof(Instruction) || size > MAX_INSTRUCTIONS * sizeof(Instruction)) {
+        file.close();
+        return false;
+      }
+      length = size / sizeof(Instruction);
+      code.reset(new Instruction[length]);
+      bool read = file.read(reinterpret_cast<uint8_t*>(code.get()), size) == size;
+      file.close();
+      for (uint16_t i = 0; read && i < length; ++i) {
+        read = isValid(code[i]);
+      }
+      if (!read) {
+        stop();
+        return false;
+      }
+
+      pc = 0;
+      memset(r, 0, sizeof r);
+      frames = 0;
+      waitFrames = 0;
+      frameDueMillis = millis();
+      memset(frame.digits, Frame::BLANK, TUBES_COUNT);
+      memset(frame.duty, 255, TUBES_COUNT);
+      frame.dot = false;
+      return true;
+    }
+
+    void stop() {
+      code.reset();
+      length = 0;
+    }
+
+    bool isRunning() const {
+      return bool(code);
+    }
+
+    // renders a frame when one is due
+    void doLoop(time_t localTime) {
+      uint32_t ms = millis();
+      if (!code || int32_t(ms - frameDueMillis) < 0) {
+        return;
+      }
+      // a late frame isn't made up for
+      frameDueMillis = int32_t(ms - frameDueMillis) < int32_t(FRAME_MILLIS) ? frameDueMillis + FRAME_MILLIS : ms + FRAME_MILLIS;
+
+      uint16_t executed = runFrame(localTime % SECS_PER_DAY);
+      ++frames;
+      ++metrics.effectFrames;
+      metrics.effectInstructions += executed;
+      if (executed > metrics.effectMaxInstructions) {
+        metrics.effectMaxInstructions = executed;
+      }
+      Frame &back = display.backFrame();
+      back = frame;
+      display.show();
+    }
+};
+
+/*
+ * Plays a precomputed animation streamed from LittleFS. The file is "NXA1", a
+ * little endian uint16 frame interval in ms, then a record per frame:
+ *
+ * - a head byte: bits 0-3 flag tubes with a new digit, bit 4 a duty mask
+ *   byte following, bit 5 is the dot, bit 6 a hold count byte following
+ * - the duty mask byte, bits 0-3 flag tubes with a new duty
+ * - the hold count, frames the frame stays on after its own
+ * - new digits, then new duties, of the flagged tubes left to right
+ *
+ * Tubes not flagged keep what they showed, so a record is 1 to 11 bytes.
+ * The file is read through two buffers: one is decoded while the other is
+ * refilled, after a frame is rendered, well ahead of being needed.
+ */
+class AnimationPlayer {
+    static constexpr uint16_t BUFFER_SIZE = 128;
+    static constexpr uint16_t MIN_FRAME_MILLIS = 10;
+
+    File file;
+    uint8_t buffers[2][BUFFER_SIZE];
+    uint16_t lengths[2] = {};
+    // buffer being decoded and the position in it
+    uint8_t current = 0;
+    uint16_t position = 0;
+    bool ended = false;
+    uint16_t frameMillis = 0;
+    uint32_t frameDueMillis = 0;
+    Frame frame;
+
+    void fill(uint8_t buffer) {
+      lengths[buffer] = file ? file.read(buffers[buffer], BUFFER_SIZE) : 0;
+    }
+
+    // false at the end of the file
+    bool nextByte(uint8_t &value) {
+      if (position == lengths[current]) {
+        uint8_t other = current ^ 1;
+        if (!lengths[other]) {
+          // not prefetched in time, unless there's nothing left to prefetch
+          if (file && file.available()) {
+            ++metrics.animationUnderruns;
+          }
+          fill(other);
+          if (!lengths[other]) {
+            return false;
+          }
+        }
+        lengths[current] = 0;
+        current = other;
+        position = 0;
+      }
+      value = buffers[current][position++];
+      return true;
+    }
+
+    // decodes the next record into frame, returns frames it's shown for
+    uint16_t decode() {
+      uint8_t head, dutyMask = 0, hold = 0;
+      if (!nextByte(head) || ((head & bit(4)) && !nextByte(dutyMask)) || ((head & bit(6)) && !nextByte(hold))) {
+        return 0;
+      }
+      for (uint8_t tube = 0; tube < TUBES_COUNT; ++tube) {
+        if ((head & bit(tube)) && !nextByte(frame.digits[tube])) {
+          return 0;
+        }
+      }
+      for (uint8_t tube = 0; tube < TUBES_COUNT; ++tube) {
+        if ((dutyMask & bit(tube)) && !nextByte(frame.duty[tube])) {
+          return 0;
+        }
+      }
+      frame.dot = head & bit(5);
+      return 1 + hold;
+    }
+
+  public:
+    bool play(PGM_P path) {
+      return play(String(FPSTR(path)));
+    }
+
+    bool play(const String &path) {
+      stop();
+      file = LittleFS.open(path, "r");
+      uint8_t header[6];
+      if (!file || file.read(header, sizeof header) != sizeof header || memcmp_P(header, PSTR("NXA1"), 4)) {
+        stop();
+        return false;
+      }
+      frameMillis = max(uint16_t(header[4] | header[5] << 8), MIN_FRAME_MILLIS);
+      fill(0);
+      fill(1);
+      current = 0;
+      position = 0;
+      ended = false;
+      frameDueMillis = millis();
+      memset(frame.digits, Frame::BLANK, TUBES_COUNT);
+      memset(frame.duty, 255, TUBES_COUNT);
+      frame.dot = false;
+      return true;
+    }
+
+    void stop() {
+      if (file) {
+        file.close();
+      }
+      lengths[0] = lengths[1] = 0;
+      ended = true;
+    }
+
+    bool isPlaying() const {
+      return !ended;
+    }
+
+    void doLoop() {
+      uint32_t ms = millis();
+      if (ended || int32_t(ms - frameDueMillis) < 0) {
+        return;
+      }
+      uint16_t frames = decode();
+      if (!frames) {
+        stop();
+        return;
+      }
+      // late frames aren't made up for, the animation slows down instead
+      frameDueMillis = (int32_t(ms - frameDueMillis) < int32_t(frameMillis) ? frameDueMillis : ms)
+        + uint32_t(frameMillis) * frames;
+      metrics.animationFrames += frames;
+      Frame &back = display.backFrame();
+      back = frame;
+      display.show();
+
+      // prefetch, the frame is out and the next one is a frame interval away
+      if (!lengths[current ^ 1]) {
+        fill(current ^ 1);
+      }
+    }
+};
+
+/*
+ * Stores an effect PUT as the raw request body, once it loads.
+ */
+class EffectUpload {
+    File file;
+    String name;
+
+  public:
+    void receive(ESP8266WebServer &webServer, HTTPRaw &raw) {
+      switch (raw.status) {
+        case RAW_START: {
+          name = webServer.arg(F("name"));
+          String path = EffectVM::pathFor(name);
+          if (path.length()) {
+            file = LittleFS.open(path, "w");
+          }
+          break;
+        }
+        case RAW_WRITE:
+          if (file && file.write(raw.buf, raw.currentSize) != raw.currentSize) {
+            file.close();
+            LittleFS.remove(EffectVM::pathFor(name));
+          }
+          break;
+        case RAW_END:
+          if (file) {
+            file.close();
+          }
+          break;
+        case RAW_ABORTED:
+          if (file) {
+            file.close();
+            LittleFS.remove(EffectVM::pathFor(name));
+          }
+          break;
+      }
+    }
+
+    void respond(ESP8266WebServer &webServer) {
+      String path = EffectVM::pathFor(name);
+      EffectVM check;
+      if (check.load(name)) {
+        webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+      } else {
+        if (path.length()) {
+          LittleFS.remove(path);
+        }
+        webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Invalid effect"));
+      }
+      name = String();
+    }
+};
+
+/*
+ * Runs the CPU at 160 MHz while any instance is alive, e.g. for the duration
+ * of a TLS request, and at 80 MHz otherwise.
+ */
+class CpuBoost {
+    static uint8_t holders;
+    static uint32_t boostedAt;
+
+    static void setCpuFrequency(uint8_t mhz) {
+      noInterrupts();
+      system_update_cpu_freq(mhz);
+      display.setCpuFrequency(mhz);
+      interrupts();
+    }
+
+  public:
+    CpuBoost() {
+      if (holders++ == 0) {
+        boostedAt = millis();
+        setCpuFrequency(SYS_CPU_160MHZ);
+      }
+    }
+
+    ~CpuBoost() {
+      if (--holders == 0) {
+        setCpuFrequency(SYS_CPU_80MHZ);
+        metrics.boostedMillis += millis() - boostedAt;
+      }
+    }
+};
+uint8_t CpuBoost::holders = 0;
+uint32_t CpuBoost::boostedAt = 0;
+
+/*
+ * Writes an image to flash as it's received, chunk by chunk, with the CPU
+ * boosted until it's done.
+ */
+class ImageWriter {
+    std::unique_ptr<CpuBoost> boost;
+    uint32_t startedAt = 0;
+    size_t written = 0;
+    int command = U_FLASH;
+    bool done = false;
+    String error = F("No image");
+
+    bool fail() {
+      StreamString updateError;
+      Update.printError(updateError);
+      error = updateError;
+      Update.end();
+      boost.reset();
+      return false;
+    }
+
+  public:
+    /*
+     * A firmware size is an upper bound, the image may turn out smaller.
+     * md5 is checked by end().
+     */
+    bool begin(size_t size, int command = U_FLASH, const char *md5 = nullptr) {
+      abort();
+      boost.reset(new CpuBoost());
+      startedAt = millis();
+      written = 0;
+      this->command = command;
+      done = false;
+      error = "";
+      if (!Update.begin(size, command) || (md5 && !Update.setMD5(md5))) {
+        return fail();
+      }
+      return true;
+    }
+
+    bool write(uint8_t *data, size_t len) {
+      if (!boost) {
+        return false;
+      }
+      if (Update.write(data, len) != len) {
+        return fail();
+      }
+      written += len;
+      return true;
+    }
+
+    // verifies the image and makes it the one to boot
+    bool end() {
+      if (!boost) {
+        return false;
+      }
+      uint32_t verifyStartedAt = millis();
+      if (!Update.end(command == U_FLASH)) {
+        return fail();
+      }
+      metrics.update(written, startedAt, millis() - verifyStartedAt);
+      boost.reset();
+      done = true;
+      return true;
+    }
+
+    void abort() {
+      if (boost) {
+        Update.end();
+        error = F("Aborted");
+        boost.reset();
+      }
+    }
+
+    // true once an image is written and verified
+    bool isDone() const {
+      return done;
+    }
+
+    const String &getError() const {
+      return error;
+    }
+};
+
+/*
+ * Writes a filesystem image to the free sketch space below the filesystem
+ * first. Only once all of it is there, reads back with the expected MD5 and
+ * has a LittleFS superblock, end() copies it over the filesystem, so a
+ * broken upload leaves the filesystem as it was. The copy itself isn't
+ * atomic: losing power during it, a few seconds, leaves the filesystem
+ * broken.
+ */
+class FsImageWriter {
+    static const size_t SECTOR_SIZE = FLASH_SECTOR_SIZE;
+
+    std::unique_ptr<CpuBoost> boost;
+    std::unique_ptr<uint8_t[]> sector;
+    uint32_t stagingAddress = 0;
+    size_t buffered = 0;
+    size_t written = 0;
+    String md5;
+    uint32_t startedAt = 0;
+    bool done = false;
+    String error = F("No image");
+
+    bool fail(const __FlashStringHelper *reason) {
+      error = reason;
+      sector.reset();
+      boost.reset();
+      return false;
+    }
+
+    bool writeSector(uint32_t address) {
+      return ESP.flashEraseSector(address / SECTOR_SIZE) && ESP.flashWrite(address, sector.get(), SECTOR_SIZE);
+    }
+
+    // MD5 of a partition's worth of flash at address, as it reads back
+    bool flashMd5(uint32_t address, String &checksum) {
+      MD5Builder builder;
+      builder.begin();
+      for (size_t offset = 0; offset < FS_PHYS_SIZE; offset += SECTOR_SIZE) {
+        if (!ESP.flashRead(address + offset, sector.get(), SECTOR_SIZE)) {
+          return false;
+        }
+        builder.add(sector.get(), SECTOR_SIZE);
+        yield();
+      }
+      builder.calculate();
+      checksum = builder.toString();
+      return true;
+    }
+
+    // littlefs keeps its superblock in either of the first two blocks
+    bool hasSuperblock() {
+      for (uint32_t block : {uint32_t(0), FS_PHYS_BLOCK}) {
+        char magic[8];
+        if (ESP.flashRead(stagingAddress + block + 8, reinterpret_cast<uint8_t *>(magic), sizeof magic)
+            && !memcmp_P(magic, PSTR("littlefs"), sizeof magic)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+  public:
+    // the image must fill the partition and come with its MD5
+    bool begin(const char *md5) {
+      abort();
+      startedAt = millis();
+      buffered = 0;
+      written = 0;
+      done = false;
+      error = "";
+      if (!md5 || strlen(md5) != 32) {
+        return fail(F("Filesystem image needs its MD5"));
+      }
+      this->md5 = md5;
+      this->md5.toLowerCase();
+      stagingAddress = FS_PHYS_ADDR - FS_PHYS_SIZE;
+      uint32_t sketchEnd = (ESP.getSketchSize() + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+      if (FS_PHYS_SIZE > FS_PHYS_ADDR || stagingAddress < sketchEnd) {
+        return fail(F("No space to stage filesystem image"));
+      }
+      sector.reset(new (std::nothrow) uint8_t[SECTOR_SIZE]);
+      if (!sector) {
+        return fail(F("Out of memory"));
+      }
+      boost.reset(new CpuBoost());
+      return true;
+    }
+
+    bool write(const uint8_t *data, size_t len) {
+      if (!boost) {
+        return false;
+      }
+      if (written + buffered + len > FS_PHYS_SIZE) {
+        return fail(F("Filesystem image too large"));
+      }
+      while (len) {
+        size_t chunk = std::min(len, SECTOR_SIZE - buffered);
+        memcpy(sector.get() + buffered, data, chunk);
+        buffered += chunk;
+        data += chunk;
+        len -= chunk;
+        if (buffered == SECTOR_SIZE) {
+          if (!writeSector(stagingAddress + written)) {
+            return fail(F("Flash write failed"));
+          }
+          written += SECTOR_SIZE;
+          buffered = 0;
+        }
+      }
+      return true;
+    }
+
+    /*
+     * Verifies the staged image and copies it over the filesystem, which
+     * must be unmounted by then.
+     */
+    bool end() {
+      if (!boost) {
+        return false;
+      }
+      if (buffered || written != FS_PHYS_SIZE) {
+        return fail(F("Filesystem image must fill the partition"));
+      }
+      uint32_t verifyStartedAt = millis();
+      String checksum;
+      if (!flashMd5(stagingAddress, checksum) || checksum != md5) {
+        return fail(F("MD5 mismatch"));
+      }
+      if (!hasSuperblock()) {
+        return fail(F("Not a LittleFS image"));
+      }
+      uint32_t verifyMillis = millis() - verifyStartedAt;
+      for (size_t offset = 0; offset < FS_PHYS_SIZE; offset += SECTOR_SIZE) {
+        if (!ESP.flashRead(stagingAddress + offset, sector.get(), SECTOR_SIZE) || !writeSector(FS_PHYS_ADDR + offset)) {
+          return fail(F("Filesystem copy failed"));
+        }
+        yield();
+      }
+      verifyStartedAt = millis();
+      if (!flashMd5(FS_PHYS_ADDR, checksum) || checksum != md5) {
+        return fail(F("Filesystem copy failed"));
+      }
+      metrics.update(written, startedAt, verifyMillis + millis() - verifyStartedAt);
+      sector.reset();
+      boost.reset();
+      done = true;
+      return true;
+    }
+
+    void abort() {
+      if (boost) {
+        fail(F("Aborted"));
+      }
+    }
+
+    // true once an image is verified and in place
+    bool isDone() const {
+      return done;
+    }
+
+    const String &getError() const {
+      return error;
+    }
+};
+
+/*
+ * Unpacks an asset bundle as it's received. A bundle is "NXB1" followed by
+ * files, each a path length byte, the path, a little endian uint32 size, the
+ * MD5 of the content and the content. Files are written next to the current
+ * ones and replace them only once every file checked out, so a broken
+ * bundle leaves the assets as they were.
+ */
+class BundleWriter {
+    static const uint8_t MAX_FILES = 8;
+    // LittleFS names are up to 31 chars, with BUNDLE_SUFFIX
+    static const uint8_t MAX_PATH_LENGTH = 27;
+
+    enum State : uint8_t {IDLE, MAGIC, PATH_LENGTH, PATH, SIZE, CHECKSUM, CONTENT};
+
+    std::unique_ptr<CpuBoost> boost;
+    State state = IDLE;
+    // the header field being received
+    uint8_t field[MAX_PATH_LENGTH + 1];
+    uint8_t fieldLength = 0;
+    uint8_t received = 0;
+    String paths[MAX_FILES];
+    uint8_t count = 0;
+    File file;
+    uint32_t remaining = 0;
+    uint8_t checksum[16];
+    MD5Builder md5;
+    uint32_t startedAt = 0;
+    uint32_t verifyMicros = 0;
+    size_t written = 0;
+    bool done = false;
+    String error = F("No bundle");
+
+    static String pendingPath(const String &path) {
+      String pending = path;
+      pending += FPSTR(BUNDLE_SUFFIX);
+      return pending;
+    }
+
+    void expect(State state, uint8_t length) {
+      this->state = state;
+      fieldLength = length;
+      received = 0;
+    }
+
+    bool fail(const __FlashStringHelper *reason) {
+      if (file) {
+        file.close();
+      }
+      // the file being received is paths[count]
+      for (uint8_t i = 0; i <= count && i < MAX_FILES; ++i) {
+        if (paths[i].length()) {
+          LittleFS.remove(pendingPath(paths[i]));
+        }
+      }
+      error = reason;
+      state = IDLE;
+      boost.reset();
+      return false;
+    }
+
+    bool endFile() {
+      file.close();
+      uint32_t hashStartedAt = micros();
+      md5.calculate();
+      uint8_t digest[16];
+      md5.getBytes(digest);
+      verifyMicros += micros() - hashStartedAt;
+      if (memcmp(digest, checksum, sizeof digest)) {
+        return fail(F("Checksum mismatch"));
+      }
+      ++count;
+      expect(PATH_LENGTH, 1);
+      return true;
+    }
+
+    bool onField() {
+      switch (state) {
+        case MAGIC:
+          if (memcmp_P(field, PSTR("NXB1"), 4)) {
+            return fail(F("Not a bundle"));
+          }
+          expect(PATH_LENGTH, 1);
+          return true;
+        case PATH_LENGTH:
+          if (!field[0] || field[0] > MAX_PATH_LENGTH) {
+            return fail(F("Invalid path"));
+          }
+          if (count == MAX_FILES) {
+            return fail(F("Too many files"));
+          }
+          expect(PATH, field[0]);
+          return true;
+        case PATH: {
+          field[fieldLength] = '\0';
+          String path(reinterpret_cast<const char*>(field));
+          // assets only, settings aren't replaced
+          if (path.length() != fieldLength || path[0] != '/' || path.indexOf('/', 1) >= 0
+              || path == FPSTR(CONFIG_FILE) || path == FPSTR(NETWORKS_FILE) || path == FPSTR(SCHEDULE_FILE)) {
+            return fail(F("Invalid path"));
+          }
+          paths[count] = path;
+          expect(SIZE, 4);
+          return true;
+        }
+        case SIZE:
+          remaining = field[0] | field[1] << 8 | field[2] << 16 | uint32_t(field[3]) << 24;
+          expect(CHECKSUM, sizeof checksum);
+          return true;
+        case CHECKSUM:
+          memcpy(checksum, field, sizeof checksum);
+          file = LittleFS.open(pendingPath(paths[count]), "w");
+          if (!file) {
+            return fail(F("Couldn't create file"));
+          }
+          md5.begin();
+          state = CONTENT;
+          return remaining || endFile();
+        default:
+          return false;
+      }
+    }
+
+  public:
+    void begin() {
+      abort();
+      boost.reset(new CpuBoost());
+      startedAt = millis();
+      verifyMicros = 0;
+      written = 0;
+      count = 0;
+      for (String &path : paths) {
+        path = String();
+      }
+      done = false;
+      error = "";
+      expect(MAGIC, 4);
+    }
+
+    bool write(const uint8_t *data, size_t len) {
+      written += len;
+      if (state == IDLE) {
+        return false;
+      }
+      while (len) {
+        if (state == CONTENT) {
+          // content goes to the file as received
+          size_t chunk = std::min(len, size_t(remaining));
+          if (file.write(data, chunk) != chunk) {
+            return fail(F("Couldn't write file"));
+          }
+          uint32_t hashStartedAt = micros();
+          md5.add(data, chunk);
+          verifyMicros += micros() - hashStartedAt;
+          data += chunk;
+          len -= chunk;
+          remaining -= chunk;
+          if (!remaining && !endFile()) {
+            return false;
+          }
+        } else {
+          size_t chunk = std::min(len, size_t(fieldLength - received));
+          memcpy(field + received, data, chunk);
+          data += chunk;
+          len -= chunk;
+          received += chunk;
+          if (received == fieldLength && !onField()) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    // replaces the assets if the bundle was complete
+    bool end() {
+      if (state == IDLE) {
+        return false;
+      }
+      if (state != PATH_LENGTH || received || !count) {
+        return fail(F("Incomplete bundle"));
+      }
+      for (uint8_t i = 0; i < count; ++i) {
+        LittleFS.rename(pendingPath(paths[i]), paths[i]);
+      }
+      metrics.update(written, startedAt, verifyMicros / 1000);
+      boost.reset();
+      state = IDLE;
+      done = true;
+      return true;
+    }
+
+    void abort() {
+      if (boost) {
+        fail(F("Aborted"));
+      }
+    }
+
+    // true once a bundle is unpacked
+    bool isDone() const {
+      return done;
+    }
+
+    const String &getError() const {
+      return error;
+    }
+};
+
+// RadioPower's access to the ESP8266 radio
+struct WiFiRadio {
+  uint32_t millis() const {
+    return ::millis();
+  }
+
+  void setSleep(RadioSleep sleep) {
+    if (sleep == RADIO_AWAKE) {
+      WiFi.setSleepMode(WIFI_NONE_SLEEP);
+    } else {
+      WiFi.setSleepMode(WIFI_MODEM_SLEEP, RADIO_LISTEN_INTERVAL);
+    }
+  }
+};
+
+/*
+ * Keeps the station on the strongest access point of its network. While
+ * RoamingPolicy finds the signal weak, runs an async scan for the SSID now
+ * and then, re-associating if another BSSID is significantly stronger.
+ * The display keeps being refreshed by its interrupt meanwhile.
+ */
+class RoamingMonitor {
+    static_assert(RoamingPolicy::BSSID_LENGTH == WL_MAC_ADDR_LENGTH, "RoamingPolicy compares whole BSSIDs");
+
+    String ssid;
+    String ssidPsk;
+    RoamingPolicy policy;
+    bool scanning = false;
+
+    void roam(int8_t networksFound) {
+      int8_t best = policy.select(WiFi, networksFound, ssid.c_str(), WiFi.BSSID());
+      if (best >= 0) {
+        WiFi.begin(ssid, ssidPsk, WiFi.channel(best), WiFi.BSSID(best));
+        policy.reset();
+        ++metrics.roams;
+      }
+    }
+
+  public:
+    // the network to roam in
+    void begin(const String &ssid, const String &ssidPsk) {
+      this->ssid = ssid;
+      this->ssidPsk = ssidPsk;
+    }
+
+    void doLoop() {
+      if (scanning) {
+        int8_t networksFound = WiFi.scanComplete();
+        if (networksFound == WIFI_SCAN_RUNNING) {
+          return;
+        }
+        scanning = false;
+        if (WiFi.isConnected()) {
+          roam(networksFound);
+        }
+        WiFi.scanDelete();
+        return;
+      }
+      if (!WiFi.isConnected()) {
+        policy.reset();
+        return;
+      }
+
+      uint32_t ms = millis();
+      if (policy.isSampleDue(ms)) {
+        policy.sample(WiFi.RSSI(), ms);
+      }
+      if (policy.scanDue(ms)) {
+        // probes for our SSID only, which is quicker than a full scan
+        WiFi.scanNetworks(true, false, 0, reinterpret_cast<uint8_t*>(const_cast<char*>(ssid.c_str())));
+        scanning = true;
+      }
+    }
+};
+
+/*
+ * Pulls firmware from a local update server. The manifest at the configured
+ * URL describes the image, e.g. {"url": "http://host/firmware.bin", "size":
+ * 401232, "md5": "..."}, which is downloaded unless its MD5 is the running
+ * sketch's. Each doLoop() writes as much of the image as has arrived, and a
+ * dropped connection is resumed from where it stopped with a Range request.
+ */
+class PullUpdater {
+    static const uint32_t POLL_MILLIS = SECS_PER_DAY * 1000;
+    static const uint32_t RETRY_MILLIS = 60000;
+    static const uint16_t TIMEOUT_MILLIS = 5000;
+    static const uint8_t MAX_FAILURES = 5;
+    // time a doLoop() may spend reading the image
+    static const uint32_t SLICE_MILLIS = 20;
+
+    String manifestUrl;
+    String imageUrl;
+    size_t imageSize = 0;
+    size_t received = 0;
+    bool pollDue = false;
+    bool downloading = false;
+    bool streaming = false;
+    uint8_t failures = 0;
+    uint32_t lastAttemptMillis = 0;
+    WiFiClient wifiClient;
+    HTTPClient http;
+    ImageWriter imageWriter;
+
+    // gives up after MAX_FAILURES in a row, until the next poll
+    void fail() {
+      if (++failures < MAX_FAILURES) {
+        return;
+      }
+      failures = 0;
+      pollDue = false;
+      if (downloading) {
+        downloading = false;
+        imageWriter.abort();
+      }
+    }
+
+    void poll() {
+      lastAttemptMillis = millis();
+      http.begin(wifiClient, manifestUrl);
+      http.setUserAgent(FPSTR(NIXIECLOCK));
+      http.setTimeout(TIMEOUT_MILLIS);
+      if (http.GET() != HTTP_CODE_OK) {
+        http.end();
+        fail();
+        return;
+      }
+      StaticJsonDocument<256> jsonDoc;
+      DeserializationError parseResult = deserializeJson(jsonDoc, http.getStream());
+      http.end();
+      const char *url = jsonDoc[F("url")];
+      const char *md5 = jsonDoc[F("md5")];
+      size_t size = jsonDoc[F("size")] | 0;
+      if (parseResult != DeserializationError::Ok || !url || strncmp_P(url, PSTR("http://"), 7)
+          || !md5 || strlen(md5) != 32 || !size) {
+        fail();
+        return;
+      }
+
+      pollDue = false;
+      failures = 0;
+      if (ESP.getSketchMD5().equalsIgnoreCase(md5) || !imageWriter.begin(size, U_FLASH, md5)) {
+        return;
+      }
+      imageUrl = url;
+      imageSize = size;
+      received = 0;
+      downloading = true;
+    }
+
+    void download() {
+      if (!streaming) {
+        lastAttemptMillis = millis();
+        http.begin(wifiClient, imageUrl);
+        http.setUserAgent(FPSTR(NIXIECLOCK));
+        http.setTimeout(TIMEOUT_MILLIS);
+        http.addHeader(F("Range"), String(F("bytes=")) + received + '-');
+        int responseCode = http.GET();
+        // a server ignoring Range is fine only for the first request
+        if (responseCode != HTTP_CODE_PARTIAL_CONTENT && !(responseCode == HTTP_CODE_OK && received == 0)) {
+          http.end();
+          fail();
+          return;
+        }
+        streaming = true;
+      }
+
+      WiFiClient *stream = http.getStreamPtr();
+      uint8_t buffer[1024];
+      for (uint32_t startedAt = millis(); millis() - startedAt < SLICE_MILLIS && received < imageSize;) {
+        size_t available = stream->available();
+        if (!available) {
+          if (!stream->connected()) {
+            // resumed by the next doLoop()
+            http.end();
+            streaming = false;
+            fail();
+          }
+          return;
+        }
+        size_t len = stream->readBytes(buffer, std::min({available, sizeof buffer, imageSize - received}));
+        if (!imageWriter.write(buffer, len)) {
+          http.end();
+          streaming = false;
+          downloading = false;
+          return;
+        }
+        received += len;
+        failures = 0;
+      }
+
+      if (received == imageSize) {
+        http.end();
+        streaming = false;
+        downloading = false;
+        if (imageWriter.end()) {
+          ESP.restart();
+        }
+      }
+    }
+
+  public:
+    ~PullUpdater() {
+      imageWriter.abort();
+    }
+
+    // an empty URL disables updates
+    void begin(const String &url) {
+      if (streaming) {
+        http.end();
+        streaming = false;
+      }
+      if (downloading) {
+        downloading = false;
+        imageWriter.abort();
+      }
+      manifestUrl = url;
+      pollDue = url.length() > 0;
+      failures = 0;
+    }
+
+    // polls the manifest now rather than when the next poll is due
+    void checkNow() {
+      if (manifestUrl.length() && !downloading) {
+        pollDue = true;
+        failures = 0;
+      }
+    }
+
+    // true while polling or downloading, which needs the network
+    bool isActive() const {
+      return pollDue || downloading;
+    }
+
+    bool isDownloading() const {
+      return downloading;
+    }
+
+    void doLoop() {
+      if (manifestUrl.length() == 0) {
+        return;
+      }
+      if (!isActive() && millis() - lastAttemptMillis >= POLL_MILLIS) {
+        pollDue = true;
+      }
+      if (!isActive() || !WiFi.isConnected() || (failures && millis() - lastAttemptMillis < RETRY_MILLIS)) {
+        return;
+      }
+      if (downloading) {
+        download();
+      } else {
+        poll();
+      }
+    }
+};
+
+String readNextValue(Stream &configFile) {
+  return readSettingsValue<String>(configFile);
+}
+
+/*
+ * Values of CONFIG_KEYS, as stored in CONFIG_FILE.
+ */
+struct Settings {
+  String values[CONFIG_KEYS_COUNT];
+  // values actually present in the file
+  uint8_t count = 0;
+
+  bool load() {
+    count = 0;
+    File configFile = flashStore.open(CONFIG_FILE);
+    if (!configFile) {
+      return false;
+    }
+    for (; count < CONFIG_KEYS_COUNT && configFile.available(); ++count) {
+      values[count] = readNextValue(configFile);
+    }
+    configFile.close();
+    return true;
+  }
+
+  // bit i is set if values[i] differ
+  uint8_t diff(const Settings &other) const {
+    return diffSettings(values, other.values);
+  }
+};
+
+/*
+ * A Wi-Fi network the clock may connect to, with hints from the last time it
+ * was seen. Higher priority networks are preferred over stronger signal.
+ */
+struct KnownNetwork {
+  String ssid;
+  String psk;
+  uint8_t priority;
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t bssid[WL_MAC_ADDR_LENGTH];
+};
+
+/*
+ * Known networks list, stored in NETWORKS_FILE as 4 lines per network: SSID,
+ * PSK, priority and "rssi,channel,bssid" hints.
+ */
+class KnownNetworks {
+  public:
+    static const uint8_t MAX_COUNT = 8;
+
+  private:
+    KnownNetwork networks[MAX_COUNT];
+    uint8_t count = 0;
+
+  public:
+    uint8_t size() const {
+      return count;
+    }
+
+    const KnownNetwork &operator[](uint8_t i) const {
+      return networks[i];
+    }
+
+    int8_t indexOf(const String &ssid) const {
+      for (uint8_t i = 0; i < count; ++i) {
+        if (networks[i].ssid == ssid) {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    bool load() {
+      count = 0;
+      File networksFile = flashStore.open(NETWORKS_FILE);
+      if (!networksFile) {
+        return false;
+      }
+      while (count < MAX_COUNT && networksFile.available()) {
+        KnownNetwork &network = networks[count++];
+        network.ssid = readNextValue(networksFile);
+        network.psk = readNextValue(networksFile);
+        network.priority = readNextValue(networksFile).toInt();
+        parseNetworkHints(readNextValue(networksFile).c_str(), network.rssi, network.channel, network.bssid);
+      }
+      networksFile.close();
+      return true;
+    }
+
+    // hints are refreshed on every boot, their writes are better coalesced
+    bool save(bool coalesce = false) {
+      StreamString content;
+      for (uint8_t i = 0; i < count; ++i) {
+        const KnownNetwork &network = networks[i];
+        char hints[32];
+        snprintf_P(
+          hints, sizeof hints, PSTR("%d,%u,%02x%02x%02x%02x%02x%02x"),
+          network.rssi, network.channel,
+          network.bssid[0], network.bssid[1], network.bssid[2],
+          network.bssid[3], network.bssid[4], network.bssid[5]
+        );
+        content.println(network.ssid);
+        content.println(network.psk);
+        content.println(network.priority);
+        content.println(hints);
+      }
+      return flashStore.write(NETWORKS_FILE, content, coalesce);
+    }
+
+    // adds a network or updates the one with the same SSID
+    bool put(const String &ssid, const String &psk, uint8_t priority) {
+      int8_t i = indexOf(ssid);
+      if (i < 0) {
+        if (count == MAX_COUNT) {
+          return false;
+        }
+        i = count++;
+        networks[i] = {ssid, String(), 0, 0, 0, {}};
+      }
+      networks[i].psk = psk;
+      networks[i].priority = priority;
+      return true;
+    }
+
+    bool remove(const String &ssid) {
+      int8_t i = indexOf(ssid);
+      if (i < 0) {
+        return false;
+      }
+      for (--count; i < count; ++i) {
+        networks[i] = networks[i + 1];
+      }
+      return true;
+    }
+
+    /*
+     * Picks the best known network among scan results, see
+     * selectKnownNetwork(), and updates its hints. Returns its index or -1
+     * if none was found, sets hintsChanged if the network moved to another
+     * channel or access point. Scan also has channel(i) and BSSID(i).
+     */
+    template <typename Scan>
+    int8_t select(Scan &scan, int8_t networksFound, bool &hintsChanged) {
+      int8_t scanIndex;
+      int8_t best = selectKnownNetwork(*this, scan, networksFound, scanIndex);
+      if (best >= 0) {
+        KnownNetwork &network = networks[best];
+        hintsChanged = network.channel != scan.channel(scanIndex)
+          || memcmp(network.bssid, scan.BSSID(scanIndex), WL_MAC_ADDR_LENGTH);
+        network.rssi = scan.RSSI(scanIndex);
+        network.channel = scan.channel(scanIndex);
+        memcpy(network.bssid, scan.BSSID(scanIndex), WL_MAC_ADDR_LENGTH);
+      }
+      return best;
+    }
+};
+
+// reads SCHEDULE_FILE, rules which don't check out are skipped
+bool loadSchedule(Scheduler &scheduler) {
+  scheduler.clear();
+  File scheduleFile = flashStore.open(SCHEDULE_FILE);
+  if (!scheduleFile) {
+    return false;
+  }
+  while (scheduler.size() < Scheduler::MAX_RULES && scheduleFile.available()) {
+    Scheduler::Rule rule;
+    if (Scheduler::parse(readNextValue(scheduleFile).c_str(), rule)) {
+      scheduler.add(rule);
+    }
+  }
+  scheduleFile.close();
+  return true;
+}
+
+bool saveSchedule(const Scheduler &scheduler) {
+  StreamString content;
+  for (uint8_t i = 0; i < scheduler.size(); ++i) {
+    const Scheduler::Rule &rule = scheduler[i];
+    content.printf_P(PSTR("%u,%u,%u,%u,%s\n"), rule.days, rule.hour, rule.minute, rule.action, rule.name);
+  }
+  return flashStore.write(SCHEDULE_FILE, content);
+}
+
+/*
+ * The one RequestHandler serving all routes of a RouteTable. ESP8266WebServer
+ * asks its handlers one by one, so fewer handlers means a faster dispatch.
+ */
+template <size_t N>
+class Router : public RequestHandler {
+    const RouteTable<N> &table;
+    std::function<void()> handlers[N];
+    std::function<void(HTTPRaw&)> rawHandlers[N];
+    std::function<void()> requestListener;
+    std::function<bool()> authenticator;
+    int8_t matched = -1;
+
+    bool isAllowed() {
+      return !table[matched].secured || (authenticator && authenticator());
+    }
+
+  public:
+    Router(const RouteTable<N> &table) : table(table) {}
+
+    // the route must be in the table
+    void on(HTTPMethod method, const char *path, std::function<void()> handler) {
+      int8_t route = table.find(method, path);
+      if (route >= 0) {
+        handlers[route] = handler;
+      }
+    }
+
+    // the raw handler gets the request body as is, before the handler is called
+    void on(HTTPMethod method, const char *path, std::function<void()> handler,
+            std::function<void(HTTPRaw&)> rawHandler) {
+      on(method, path, handler);
+      int8_t route = table.find(method, path);
+      if (route >= 0) {
+        rawHandlers[route] = rawHandler;
+      }
+    }
 
-const char MIME_TYPE_JSON[] PROGMEM = "application/json";
-const char MIME_TYPE_TEXT[] PROGMEM = "text/plain";
+    // called for every request, routed or not
+    void onRequest(std::function<void()> listener) {
+      requestListener = listener;
+    }
 
-const char GEOLOCATE_API_URL[] PROGMEM = "https://www.googleapis.com/geolocation/v1/geolocate?key=";
-const char TIMEZONE_API_URL[] PROGMEM = "https://maps.googleapis.com/maps/api/timezone/json?key=";
+    // checks credentials of requests to secured routes, which are refused without one
+    void onAuthenticate(std::function<bool()> authenticator) {
+      this->authenticator = authenticator;
+    }
 
-struct Location {
-  double_t lat;
-  double_t lng;
+    bool canHandle(HTTPMethod method, String uri) override {
+      if (requestListener) {
+        requestListener();
+      }
+      matched = table.find(method, uri.c_str());
+      return matched >= 0 && handlers[matched];
+    }
 
-  bool isValid() {
-    return !(isnan(lat) || isnan(lng));
-  }
+    bool handle(ESP8266WebServer &server, HTTPMethod requestMethod, String requestUri) override {
+      if (isAllowed()) {
+        handlers[matched]();
+      } else {
+        server.requestAuthentication(DIGEST_AUTH, String(FPSTR(NIXIECLOCK)).c_str());
+      }
+      return true;
+    }
+
+    // asked after canHandle() for bodies which aren't forms, an unauthenticated one is refused by handle()
+    bool canRaw(String uri) override {
+      return matched >= 0 && rawHandlers[matched] && isAllowed();
+    }
+
+    void raw(ESP8266WebServer &server, String requestUri, HTTPRaw &raw) override {
+      rawHandlers[matched](raw);
+    }
+};
+
+/*
+ * Answers 404 to requests for files which aren't web assets, see
+ * isWebAsset(). Added after the routes and before serveStatic(), which
+ * would serve any file of the filesystem.
+ */
+class AssetGuard : public RequestHandler {
+  public:
+    bool canHandle(HTTPMethod method, String uri) override {
+      return (method == HTTP_GET || method == HTTP_HEAD) && !isWebAsset(uri.c_str());
+    }
+
+    bool handle(ESP8266WebServer &server, HTTPMethod requestMethod, String requestUri) override {
+      server.send_P(404, MIME_TYPE_TEXT, PSTR("Not found"));
+      return true;
+    }
 };
-const Location INVALID_LOCATION = {nan("loc"), nan("loc")};
 
 /*
  * Describes ESP8266 controller behavior.
@@ -58,10 +2051,81 @@ class IBehavior {
     virtual void doLoop() = 0;
 
   protected:
-    static String readNextValue(Stream &configFile) {
-      String value = configFile.readStringUntil('\r');
-      configFile.readStringUntil('\n');
-      return value;
+    // checks a value of CONFIG_KEYS[keyIndex] before it's written to the config file
+    static bool isValidSetting(uint8_t keyIndex, const String &value) {
+      // the config file is line based
+      if (value.indexOf('\r') >= 0 || value.indexOf('\n') >= 0) {
+        return false;
+      }
+      int32_t offset;
+      switch (keyIndex) {
+        case CONFIG_SSID:
+          return value.length() > 0 && value.length() <= 32;
+        case CONFIG_SSID_PSK:
+          return value.length() == 0 || (value.length() >= 8 && value.length() <= 64);
+        case CONFIG_API_KEY: // goes into URLs as is
+          if (value.length() == 0 || value.length() > 64) {
+            return false;
+          }
+          for (char c : value) {
+            if (!isAlphaNumeric(c) && c != '-' && c != '_') {
+              return false;
+            }
+          }
+          return true;
+        case CONFIG_TZ:
+          return value == F("auto") || parseTzOffset(value.c_str(), offset);
+        case CONFIG_OTA_URL: // a local update server, no TLS
+          return value.length() == 0 || (value.startsWith(F("http://")) && value.length() <= 128);
+        default:
+          return false;
+      }
+    }
+
+    static void sendSettings(ESP8266WebServer &webServer, bool withSecrets) {
+      String jsonStr;
+      Settings settings;
+      if (settings.load()) {
+        StaticJsonDocument<512> jsonDoc;
+        settingsToJson(jsonDoc, settings.values, settings.count, withSecrets);
+        serializeJson(jsonDoc, jsonStr);
+      } else {
+        jsonStr = F("{}");
+      }
+      webServer.send(200, FPSTR(MIME_TYPE_JSON), jsonStr);
+    }
+
+    /*
+     * Validates and writes POST-ed settings, returns true if they were
+     * written. Secrets left out of the request are taken from current, if
+     * given, as sendSettings() may not have shown them.
+     */
+    static bool storeSettings(ESP8266WebServer &webServer, const Settings *current = nullptr) {
+      String values[CONFIG_KEYS_COUNT];
+      for (int i = 0; i < CONFIG_KEYS_COUNT; ++i) {
+        ConfigKey key;
+        memcpy_P(&key, &CONFIG_KEYS[i], sizeof key);
+        values[i] = current && key.secret && !webServer.hasArg(key.name)
+          ? current->values[i]
+          : webServer.arg(key.name);
+        if (!isValidSetting(i, values[i])) {
+          webServer.send(400, FPSTR(MIME_TYPE_TEXT), String(F("Invalid setting: ")) + key.name);
+          return false;
+        }
+      }
+
+      StreamString content;
+      for (const String &value : values) {
+        content.println(value);
+      }
+      // an unchanged config isn't written at all
+      if (flashStore.write(CONFIG_FILE, content)) {
+        webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        return true;
+      } else {
+        webServer.send_P(500, MIME_TYPE_TEXT, PSTR("Couldn't write config file"));
+        return false;
+      }
     }
 };
 
@@ -87,63 +2151,120 @@ class Context : public IBehavior {
 };
 
 /*
- * Clocks mode behavior.
+ * Countdown and stopwatch on the tubes, see TimerClock.
  */
-class ClocksBehavior : public IBehavior {
-    // RFC7231 date is "Tue, 15 Nov 1994 08:12:31 GMT"
-    static time_t parseRFC7231Date(const String &date) {
-      String weekDays = F("SunMonTueWedThuFriSat");
-      String months = F("JanFebMarAprMayJunJulAugSepOctNovDec");
-      uint8_t year = CalendarYrToTm(date.substring(12, 16).toInt());
-      uint8_t month = months.indexOf(date.substring(8, 11)) / 3 + 1;
-      uint8_t day = date.substring(5, 7).toInt();
-      uint8_t weekDay = weekDays.indexOf(date.substring(0, 3)) / 3 + 1;
-      uint8_t hours = date.substring(17, 19).toInt();
-      uint8_t minutes = date.substring(20, 22).toInt();
-      uint8_t seconds = date.substring(23, 25).toInt();
-
-      TimeElements time = {
-        seconds, minutes, hours, weekDay, day, month, year
-      };
-      return makeTime(time);
+class TimerBehavior : public IBehavior {
+    static_assert(TimerClock::BLANK == Frame::BLANK, "TimerClock blanks tubes as Frame does");
+
+    TimerClock clock;
+    uint8_t duty = 255;
+    Frame shown = {};
+
+  public:
+    TimerBehavior(TimerClock::Mode mode, uint32_t durationSecs = 0) : clock(mode, durationSecs, micros64()) {}
+
+    void pause() {
+      clock.pause(micros64());
+    }
+
+    void resume() {
+      clock.resume(micros64());
+    }
+
+    // a countdown finishes once it's done flashing
+    bool isFinished() const {
+      return clock.isFinished(micros64());
+    }
+
+    void setDuty(uint8_t duty) {
+      this->duty = duty;
+    }
+
+    void doLoop() override {
+      TimerClock::Face face = clock.faceAt(micros64());
+      Frame frame;
+      memcpy(frame.digits, face.digits, TUBES_COUNT);
+      memset(frame.duty, duty, TUBES_COUNT);
+      frame.dot = face.dot;
+      if (!memcmp(&frame, &shown, sizeof frame)) {
+        return;
+      }
+      shown = frame;
+      Frame &back = display.backFrame();
+      back = frame;
+      display.show();
     }
+};
 
+/*
+ * Clocks mode behavior.
+ */
+class ClocksBehavior : public IBehavior {
     void init() {
       initialized = true;
 
-      File configFile = LittleFS.open(FPSTR(CONFIG_FILE), "r");
-      if (!configFile) {
+      if (!settings.load()) {
         return;
       }
-      String ssid = readNextValue(configFile);
-      String ssidPsk = readNextValue(configFile);
-      apiKey = readNextValue(configFile);
-      String tz = readNextValue(configFile);
-      configFile.close();
+      String ssid = settings.values[CONFIG_SSID];
+      String ssidPsk = settings.values[CONFIG_SSID_PSK];
+      apiKey = settings.values[CONFIG_API_KEY];
 
+      radio.setNeeded(RADIO_SYNC, true);
       // make sure only STA mode is enabled
       WiFi.mode(WIFI_STA);
-      WiFi.begin(ssid, ssidPsk);
+
+      // one scan both picks the network and feeds geolocation
+      uint32_t selectionStartedAt = millis();
+      KnownNetworks networks;
+      networks.load();
+      // the network from the settings is always known, at the lowest priority
+      String settingsSsid = ssid;
+      bool settingsNetworkStored = networks.indexOf(ssid) >= 0;
+      if (!settingsNetworkStored) {
+        networks.put(ssid, ssidPsk, 0);
+      }
+      int8_t networksFound = WiFi.scanNetworks(false, true);
+      bool hintsChanged = false;
+      int8_t selected = networks.select(WiFi, networksFound, hintsChanged);
+      metrics.networkSelectionMillis = millis() - selectionStartedAt;
+      if (selected >= 0) {
+        const KnownNetwork &network = networks[selected];
+        ssid = network.ssid;
+        ssidPsk = network.psk;
+        WiFi.begin(ssid, ssidPsk, network.channel, network.bssid);
+        if (hintsChanged) {
+          if (!settingsNetworkStored) {
+            networks.remove(settingsSsid);
+          }
+          networks.save(true);
+        }
+      } else {
+        WiFi.begin(ssid, ssidPsk);
+      }
+      roaming.begin(ssid, ssidPsk);
       if (WiFi.waitForConnectResult() != WL_CONNECTED) {
         return;
       }
 
-      if (tz == F("auto")) {
-        int8_t networksFound = WiFi.scanNetworks(false, true);
+      if (settings.values[CONFIG_TZ] == F("auto")) {
         if (networksFound > 1) {
           location = geolocate(networksFound);
         }
-      } else {
-        // tz is a ±hh:mm offset
-        String hours = tz.substring(1, 3);
-        String minutes = tz.substring(4, 6);
-        tzOffset = hours.toInt() * SECS_PER_HOUR + minutes.toInt() * SECS_PER_MIN;
-        if (tz[0] == '-') {
-          tzOffset = -tzOffset;
-        }
+      } else if (!parseTzOffset(settings.values[CONFIG_TZ].c_str(), tzOffset)) {
+        tzOffset = 0;
       }
 
-      setSyncInterval(SECS_PER_DAY);
+      setSyncInterval(SyncSchedule::INTERVAL_SECS);
+      sync();
+      updater.begin(settings.values[CONFIG_OTA_URL]);
+      loadSchedule(scheduler);
+      startManagement();
+      animation.play(STARTUP_ANIMATION);
+    }
+
+    // (re)sets the sync provider, which makes TimeLib sync right away
+    void sync() {
       setSyncProvider(
         [](void *arg) {
           return reinterpret_cast<ClocksBehavior*>(arg)->getTime();
@@ -152,6 +2273,354 @@ class ClocksBehavior : public IBehavior {
       );
     }
 
+    // the config mode routes which make sense in clock mode too
+    void startManagement() {
+      auto router = new Router<sizeof CLOCKS_ROUTES / sizeof *CLOCKS_ROUTES>(CLOCKS_ROUTE_TABLE);
+      webServer.addHandler(router);
+      // anyone on the network may look, changes need the API key
+      router->onAuthenticate([&]() {
+        return webServer.authenticate(String(FPSTR(NIXIECLOCK)).c_str(), apiKey.c_str());
+      });
+      router->on(HTTP_GET, "/settings", [&]() {
+        sendSettings(webServer, false);
+      });
+      router->on(HTTP_POST, "/settings", [&]() {
+        Settings previous = settings;
+        if (storeSettings(webServer, &previous)) {
+          settings.load();
+          applySettings(settings.diff(previous));
+        }
+      });
+      router->on(HTTP_GET, "/metrics", [&]() {
+        String jsonStr;
+        metrics.toJson(jsonStr);
+        webServer.send(200, FPSTR(MIME_TYPE_JSON), jsonStr);
+      });
+      router->on(HTTP_PUT, "/effects", [&]() {
+        effectUpload.respond(webServer);
+      }, [&](HTTPRaw &raw) {
+        effectUpload.receive(webServer, raw);
+      });
+      // plays an effect, the time is back once it halts
+      router->on(HTTP_POST, "/effects", [&]() {
+        if (effects.load(webServer.arg(F("name")))) {
+          webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        } else {
+          webServer.send_P(404, MIME_TYPE_TEXT, PSTR("Unknown effect"));
+        }
+      });
+      router->on(HTTP_POST, "/timer", [&]() {
+        if (timerCommand(webServer.arg(F("command")))) {
+          webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        } else {
+          webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Invalid command"));
+        }
+      });
+      router->on(HTTP_POST, "/messages", [&]() {
+        // keeps the default if not given
+        auto numberArg = [&](const __FlashStringHelper *name, uint32_t max, uint32_t &number) {
+          String value = webServer.arg(name);
+          return value.length() == 0 || parseUnsigned(value.c_str(), max, number);
+        };
+        uint32_t value;
+        uint32_t priority = 0;
+        uint32_t ttlSecs = MessageQueue::DEFAULT_TTL_SECS;
+        uint32_t showSecs = MessageQueue::DEFAULT_SHOW_SECS;
+        if (!parseUnsigned(webServer.arg(F("value")).c_str(), MessageQueue::MAX_VALUE, value)
+            || !numberArg(F("priority"), 255, priority) || !numberArg(F("ttl"), SECS_PER_DAY, ttlSecs)
+            || !numberArg(F("duration"), MessageQueue::MAX_SHOW_MILLIS / 1000, showSecs)) {
+          webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Invalid message"));
+          return;
+        }
+        if (enqueueMessage(value, priority, ttlSecs, showSecs)) {
+          webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        } else {
+          webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Invalid message or queue full"));
+        }
+      });
+#ifdef NIXIECLOCK_TIMELINE
+      router->on(HTTP_GET, "/timeline", [&]() {
+        StreamString timeline;
+        display.dumpTimeline(timeline);
+        webServer.send(200, FPSTR(MIME_TYPE_TEXT), timeline);
+      });
+#endif
+#ifdef NIXIECLOCK_HEAPDUMP
+      router->on(HTTP_GET, "/heap", [&]() {
+        HeapSnapshot snapshot;
+        snapshot.take();
+        snapshot.send(webServer);
+      });
+#endif
+      router->on(HTTP_GET, "/schedule", [&]() {
+        DynamicJsonDocument jsonDoc(96 * Scheduler::MAX_RULES);
+        for (uint8_t i = 0; i < scheduler.size(); ++i) {
+          const Scheduler::Rule &rule = scheduler[i];
+          JsonObject item = jsonDoc.createNestedObject();
+          item[F("days")] = rule.days;
+          if (rule.hour == Scheduler::EVERY_HOUR) {
+            item[F("hour")] = F("*");
+          } else {
+            item[F("hour")] = rule.hour;
+          }
+          item[F("minute")] = rule.minute;
+          item[F("action")] = FPSTR(SCHEDULE_ACTIONS[rule.action].name);
+          item[F("name")] = rule.name;
+        }
+        String jsonStr;
+        serializeJson(jsonDoc, jsonStr);
+        webServer.send(200, FPSTR(MIME_TYPE_JSON), jsonStr);
+      });
+      router->on(HTTP_POST, "/schedule", [&]() {
+        auto numberArg = [&](const __FlashStringHelper *name, uint32_t max, uint8_t &field) {
+          uint32_t number;
+          if (!parseUnsigned(webServer.arg(name).c_str(), max, number)) {
+            return false;
+          }
+          field = number;
+          return true;
+        };
+        Scheduler::Rule rule = {};
+        bool everyHour = webServer.arg(F("hour")) == F("*");
+        if (!numberArg(F("days"), (1 << 7) - 1, rule.days) || !numberArg(F("minute"), 59, rule.minute)
+            || (!everyHour && !numberArg(F("hour"), 23, rule.hour))) {
+          webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Invalid rule"));
+          return;
+        }
+        if (everyHour) {
+          rule.hour = Scheduler::EVERY_HOUR;
+        }
+        rule.action = Scheduler::ACTIONS_COUNT;
+        for (uint8_t i = 0; i < Scheduler::ACTIONS_COUNT; ++i) {
+          if (webServer.arg(F("action")) == FPSTR(SCHEDULE_ACTIONS[i].name)) {
+            rule.action = Scheduler::Action(i);
+          }
+        }
+        strlcpy(rule.name, webServer.arg(F("name")).c_str(), sizeof rule.name);
+        if (!scheduler.add(rule)) {
+          webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Invalid rule"));
+        } else if (saveSchedule(scheduler)) {
+          webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        } else {
+          webServer.send_P(500, MIME_TYPE_TEXT, PSTR("Couldn't write schedule file"));
+        }
+      });
+      router->on(HTTP_DELETE, "/schedule", [&]() {
+        uint32_t index;
+        if (!parseUnsigned(webServer.arg(F("index")).c_str(), Scheduler::MAX_RULES - 1, index) || !scheduler.remove(index)) {
+          webServer.send_P(404, MIME_TYPE_TEXT, PSTR("Unknown rule"));
+        } else if (saveSchedule(scheduler)) {
+          webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        } else {
+          webServer.send_P(500, MIME_TYPE_TEXT, PSTR("Couldn't write schedule file"));
+        }
+      });
+      router->on(HTTP_DELETE, "/effects", [&]() {
+        String path = EffectVM::pathFor(webServer.arg(F("name")));
+        if (path.length() && LittleFS.remove(path)) {
+          webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        } else {
+          webServer.send_P(404, MIME_TYPE_TEXT, PSTR("Unknown effect"));
+        }
+      });
+      webServer.addHandler(new AssetGuard());
+      webServer.serveStatic("/", LittleFS, "/", "max-age=86400");
+      webServer.begin();
+      // keep-alive responses are small writes, don't let Nagle hold them back
+      webServer.getServer().setNoDelay(true);
+      commandUdp.begin(COMMAND_UDP_PORT);
+      radio.setNeeded(RADIO_MANAGEMENT, true, false);
+    }
+
+    /*
+     * Commands are "countdown <secs>", "stopwatch", "pause", "resume" and
+     * "stop", the same over HTTP and UDP, src/send-command.py signs them.
+     */
+    bool timerCommand(String command) {
+      command.trim();
+      if (command.startsWith(F("countdown "))) {
+        long secs = command.substring(10).toInt();
+        if (secs <= 0 || secs > 100 * SECS_PER_HOUR) {
+          return false;
+        }
+        timer.reset(new TimerBehavior(TimerClock::COUNTDOWN, secs));
+      } else if (command == F("stopwatch")) {
+        timer.reset(new TimerBehavior(TimerClock::STOPWATCH));
+      } else if (command == F("pause") && timer) {
+        timer->pause();
+      } else if (command == F("resume") && timer) {
+        timer->resume();
+      } else if (command == F("stop")) {
+        timer.reset();
+      } else {
+        return false;
+      }
+      return true;
+    }
+
+    void runScheduled(const Scheduler::Rule &rule) {
+      switch (rule.action) {
+        case Scheduler::ACTION_ANIMATION:
+          animation.play(assetPath(rule.name, ANIMATION_EXTENSION));
+          break;
+        case Scheduler::ACTION_EFFECT:
+          effects.load(rule.name);
+          break;
+        case Scheduler::ACTION_CATHODE_CLEANING:
+          cleaning = true;
+          cleaningStartedAt = millis();
+          break;
+        case Scheduler::ACTION_UPDATE_CHECK:
+          updater.checkNow();
+          break;
+        default:
+          break;
+      }
+    }
+
+    /*
+     * Cycles every cathode for a while, so digits shown rarely don't get
+     * poisoned by sputtering from the ones shown all the time.
+     */
+    bool showCathodeCleaning() {
+      static const uint32_t CLEANING_MILLIS = 5 * 60000;
+      static const uint32_t DIGIT_MILLIS = 200;
+      uint32_t elapsed = millis() - cleaningStartedAt;
+      if (elapsed >= CLEANING_MILLIS) {
+        cleaning = false;
+        return false;
+      }
+      uint8_t digit = elapsed / DIGIT_MILLIS % 10;
+      const Frame &shown = display.frontFrame();
+      if (shown.digits[0] != digit || shown.duty[0] != 255) {
+        Frame &frame = display.backFrame();
+        memset(frame.digits, digit, TUBES_COUNT);
+        memset(frame.duty, 255, TUBES_COUNT);
+        frame.dot = false;
+        display.show();
+      }
+      return true;
+    }
+
+    // "message <value> [<priority> [<ttl secs> [<duration secs>]]]"
+    bool messageCommand(const char *command) {
+      long value, priority = 0, ttlSecs = MessageQueue::DEFAULT_TTL_SECS, showSecs = MessageQueue::DEFAULT_SHOW_SECS;
+      if (sscanf(command, "message %ld %ld %ld %ld", &value, &priority, &ttlSecs, &showSecs) < 1) {
+        return false;
+      }
+      return enqueueMessage(value, priority, ttlSecs, showSecs);
+    }
+
+    bool enqueueMessage(long value, long priority, long ttlSecs, long showSecs) {
+      if (value < 0 || value > MessageQueue::MAX_VALUE || priority < 0 || priority > 255
+          || ttlSecs <= 0 || ttlSecs > SECS_PER_DAY || showSecs <= 0 || showSecs > MessageQueue::MAX_SHOW_MILLIS / 1000) {
+        return false;
+      }
+      return messages.push(value, priority, ttlSecs * 1000, showSecs * 1000, millis());
+    }
+
+    /*
+     * A datagram is "<unix time, ms> <command> <HMAC>", the HMAC being the
+     * hex HMAC-SHA256 of what precedes it with the API key. The time must be
+     * within a minute of the clock's and later than that of the last command
+     * accepted, so a captured datagram can't be replayed. Returns the command
+     * or nullptr if the datagram doesn't check out.
+     */
+    const char *authenticateCommand(char *datagram) {
+      static const uint8_t HMAC_LENGTH = 32;
+      static const int32_t WINDOW_SECS = 60;
+      char *command = strchr(datagram, ' ');
+      char *hmac = strrchr(datagram, ' ');
+      if (apiKey.isEmpty() || !command || hmac == command || strlen(hmac + 1) != 2 * HMAC_LENGTH) {
+        return nullptr;
+      }
+      *hmac++ = '\0';
+      String expected = experimental::crypto::SHA256::hmac(datagram, apiKey.c_str(), apiKey.length(), HMAC_LENGTH);
+      if (expected.length() != 2 * HMAC_LENGTH) {
+        return nullptr;
+      }
+      // compares all of it, the time taken mustn't tell how much of a guess was right
+      uint8_t difference = 0;
+      for (uint8_t i = 0; i < 2 * HMAC_LENGTH; ++i) {
+        difference |= (expected[i] | 0x20) ^ (hmac[i] | 0x20);
+      }
+      char *end;
+      uint64_t sentMillis = strtoull(datagram, &end, 10);
+      int64_t offsetSecs = int64_t(sentMillis / 1000) - now();
+      if (difference || end != command || sentMillis <= lastCommandMillis
+          || offsetSecs < -WINDOW_SECS || offsetSecs > WINDOW_SECS) {
+        return nullptr;
+      }
+      lastCommandMillis = sentMillis;
+      return command + 1;
+    }
+
+    // timer and message commands over UDP, a datagram each
+    void receiveCommands() {
+      if (!commandUdp.parsePacket()) {
+        return;
+      }
+      char datagram[128];
+      int length = commandUdp.read(datagram, sizeof datagram - 1);
+      datagram[length > 0 ? length : 0] = '\0';
+      const char *command = authenticateCommand(datagram);
+      if (!command) {
+        ++metrics.commandsRejected;
+      } else if (!strncmp_P(command, PSTR("message "), 8)) {
+        messageCommand(command);
+      } else {
+        timerCommand(command);
+      }
+    }
+
+    /*
+     * Applies only what changed, see settingsActions().
+     * Blocking work is left for doLoop(), after the response is sent.
+     */
+    void applySettings(uint8_t changed) {
+      uint8_t actions = settingsActions(changed, settings.values[CONFIG_TZ].c_str());
+      if (actions & SETTINGS_RECONNECT) {
+        roaming.begin(settings.values[CONFIG_SSID], settings.values[CONFIG_SSID_PSK]);
+        WiFi.begin(settings.values[CONFIG_SSID], settings.values[CONFIG_SSID_PSK]);
+      }
+      if (actions & SETTINGS_SYNC) {
+        apiKey = settings.values[CONFIG_API_KEY];
+        syncPending = true;
+      }
+      if (actions & SETTINGS_GEOLOCATE) {
+        geolocationPending = true;
+      }
+      if (actions & SETTINGS_TZ_OFFSET) {
+        // getTime() mustn't look the offset up anymore
+        location = INVALID_LOCATION;
+        if (!parseTzOffset(settings.values[CONFIG_TZ].c_str(), tzOffset)) {
+          tzOffset = 0;
+        }
+      }
+      if (actions & SETTINGS_UPDATER) {
+        updater.begin(settings.values[CONFIG_OTA_URL]);
+      }
+    }
+
+    void applyPending() {
+      if (!(geolocationPending || syncPending) || !WiFi.isConnected()) {
+        return;
+      }
+      radio.setNeeded(RADIO_SYNC, true);
+      if (geolocationPending) {
+        geolocationPending = false;
+        int8_t networksFound = WiFi.scanNetworks(false, true);
+        if (networksFound > 1) {
+          location = geolocate(networksFound);
+        }
+        syncPending = true;
+      }
+      if (syncPending) {
+        syncPending = false;
+        sync();
+      }
+    }
+
     Location geolocate(int8_t networksCount) {
       DynamicJsonDocument jsonDoc(900);
       jsonDoc[F("considerIp")] = F("true");
@@ -167,12 +2636,16 @@ class ClocksBehavior : public IBehavior {
         return INVALID_LOCATION;
       }
 
+      CpuBoost boost;
       HTTPClient https;
       String geolocateUrl = String(FPSTR(GEOLOCATE_API_URL)) + apiKey;
       https.begin(wifiClient, geolocateUrl);
       https.addHeader(F("Content-Type"), FPSTR(MIME_TYPE_JSON));
       https.setUserAgent(FPSTR(NIXIECLOCK));
-      if (https.POST(jsonStr) != HTTP_CODE_OK) {
+      uint32_t requestedAt = millis();
+      int responseCode = https.POST(jsonStr);
+      metrics.tlsRequest(requestedAt);
+      if (responseCode != HTTP_CODE_OK) {
         https.end();
         return INVALID_LOCATION;
       }
@@ -182,50 +2655,78 @@ class ClocksBehavior : public IBehavior {
       https.end();
       if (parseResult == DeserializationError::Ok) {
         JsonObject location = jsonDoc[F("location")];
-        return {
-          location[F("lat")],
-          location[F("lng")]
-        };
+        JsonVariant lat = location[F("lat")];
+        JsonVariant lng = location[F("lng")];
+        if (lat.is<double>() && lng.is<double>()
+            && fabs(lat.as<double>()) <= 90 && fabs(lng.as<double>()) <= 180) {
+          return {lat, lng};
+        }
       }
 
       return INVALID_LOCATION;
     }
 
     time_t getTime() {
+      CpuBoost boost;
       HTTPClient https;
       // https.setReuse(true);
       https.setUserAgent(FPSTR(NIXIECLOCK));
 
       const char *dateHeader[] = {"Date"};
-      String timezoneUrl = String(FPSTR(TIMEZONE_API_URL)) + apiKey;
-      https.begin(wifiClient, timezoneUrl);
+      String url;
+      timezoneUrl(url, apiKey.c_str());
+      https.begin(wifiClient, url);
       https.collectHeaders(dateHeader, 1);
-      if (https.sendRequest("HEAD") != HTTP_CODE_OK) {
+      uint32_t requestedAt = millis();
+      int responseCode = https.sendRequest("HEAD");
+      metrics.tlsRequest(requestedAt);
+      if (responseCode != HTTP_CODE_OK) {
         https.end();
+        syncSchedule.failed(millis());
+        ++metrics.syncFailures;
         return 0;
       }
 
       String date = https.header(dateHeader[0]);
       https.end();
-      time_t time = parseRFC7231Date(date);
+      time_t time = parseRFC7231Date(date.c_str());
 
-      if (location.isValid()) {
-        timezoneUrl += String(F("&location=")) + location.lat + ',' + location.lng + F("&timestamp=") + time;
+      // can't call now() here, it's the sync provider being called from now()
+      uint32_t ms = millis();
+      if (!time) {
+        syncSchedule.failed(ms);
+        ++metrics.syncFailures;
+        return 0;
+      }
+      metrics.displayErrorSecs = syncSchedule.succeeded(time, ms);
+      ++metrics.syncs;
 
-        https.begin(wifiClient, timezoneUrl);
+      if (location.isValid()) {
+        appendTimezoneQuery(url, location, time);
+        https.begin(wifiClient, url);
         https.collectHeaders(nullptr, 0);
         if (https.GET() != HTTP_CODE_OK) {
           https.end();
           return time;
         }
 
-        StaticJsonDocument<350> jsonDoc;
-        DeserializationError parseResult = deserializeJson(jsonDoc, https.getStream());
+        // only the offsets are kept, the rest of the response is skipped
+        StaticJsonDocument<64> filter;
+        filter[F("rawOffset")] = true;
+        filter[F("dstOffset")] = true;
+        StaticJsonDocument<96> jsonDoc;
+        DeserializationError parseResult = deserializeJson(
+          jsonDoc, https.getStream(), DeserializationOption::Filter(filter)
+        );
         https.end();
-        if (parseResult == DeserializationError::Ok) {
-          int32_t rawOffset = jsonDoc[F("rawOffset")];
-          int32_t dstOffset = jsonDoc[F("dstOffset")];
-          tzOffset = rawOffset + dstOffset;
+        JsonVariant rawOffset = jsonDoc[F("rawOffset")];
+        JsonVariant dstOffset = jsonDoc[F("dstOffset")];
+        if (parseResult == DeserializationError::Ok && rawOffset.is<int32_t>() && dstOffset.is<int32_t>()) {
+          int32_t offset = rawOffset.as<int32_t>() + dstOffset.as<int32_t>();
+          // UTC-12:00 to UTC+14:00, give or take a DST hour
+          if (abs(offset) <= 15 * SECS_PER_HOUR) {
+            tzOffset = offset;
+          }
         }
       }
 
@@ -235,7 +2736,28 @@ class ClocksBehavior : public IBehavior {
     WiFiClientSecure wifiClient;
     String apiKey;
     int32_t tzOffset = 0;
+    SyncSchedule syncSchedule;
     Location location = INVALID_LOCATION;
+    Settings settings;
+    ESP8266WebServer webServer;
+    bool syncPending = false;
+    bool geolocationPending = false;
+    RadioPower<WiFiRadio> radio{WiFiRadio(), metrics.radio};
+    RoamingMonitor roaming;
+    SolarBrightness brightness;
+    PullUpdater updater;
+    EffectVM effects;
+    EffectUpload effectUpload;
+    AnimationPlayer animation;
+    int8_t lastHour = -1;
+    std::unique_ptr<TimerBehavior> timer;
+    WiFiUDP commandUdp;
+    // of the last command accepted
+    uint64_t lastCommandMillis = 0;
+    Scheduler scheduler;
+    MessageQueue messages{metrics.messages};
+    bool cleaning = false;
+    uint32_t cleaningStartedAt = 0;
     bool initialized = false;
 
   public:
@@ -244,14 +2766,63 @@ class ClocksBehavior : public IBehavior {
     }
 
     ~ClocksBehavior() {
+      webServer.stop();
+      commandUdp.stop();
       wifiClient.stopAll();
     }
 
     void doLoop() override {
       // init() has blocking operations and should be performed in the loop()
       if (initialized) {
-        Serial.println(now() + tzOffset);
-        delay(5000);
+        time_t localTime = now() + tzOffset;
+        uint8_t duty = brightness.dutyAt(localTime, location, tzOffset);
+        display.setHvDuty(hvDutyFor(duty));
+        // the hourly show, once the time is known
+        int8_t hour = localTime % SECS_PER_DAY / SECS_PER_HOUR;
+        if (hour != lastHour && timeStatus() != timeNotSet) {
+          if (lastHour >= 0) {
+            animation.play(HOURLY_ANIMATION);
+          }
+          lastHour = hour;
+        }
+        if (timer && timer->isFinished()) {
+          timer.reset();
+        }
+        if (timeStatus() != timeNotSet) {
+          for (int8_t rule; (rule = scheduler.due(localTime)) >= 0;) {
+            runScheduled(scheduler[rule]);
+          }
+        }
+        if (timer) {
+          timer->setDuty(duty);
+          timer->doLoop();
+        } else if (effects.isRunning()) {
+          effects.doLoop(localTime);
+        } else if (animation.isPlaying()) {
+          animation.doLoop();
+        } else {
+          int16_t message = messages.doLoop(millis());
+          if (message >= 0) {
+            display.showNumber(message, duty);
+          } else if (!cleaning || !showCathodeCleaning()) {
+            display.showTime(localTime, duty);
+          }
+        }
+        radio.setNeeded(RADIO_SYNC, syncSchedule.isSyncDue(millis()));
+        radio.sample();
+        roaming.doLoop();
+        webServer.handleClient();
+        receiveCommands();
+        // a kept-alive client is served with the radio awake and no loop delay
+        bool serving = webServer.client().connected();
+        radio.setNeeded(RADIO_MANAGEMENT, true, serving);
+        applyPending();
+        radio.setNeeded(RADIO_UPDATE, updater.isActive());
+        updater.doLoop();
+        // timers, effects and animations render at up to 100 Hz
+        if (!serving && !updater.isDownloading() && !timer && !effects.isRunning() && !animation.isPlaying()) {
+          delay(50);
+        }
       } else {
         init();
       }
@@ -263,10 +2834,10 @@ class ClocksBehavior : public IBehavior {
  */
 class ConfigBehavior : public IBehavior {
     /*
-     * A RequestHandler that sets current behavior to clocks mode if no client
-     * requested the configraion web page for a specified amount of seconds.
+     * Sets current behavior to clocks mode if no client requested the
+     * configraion web page for a specified amount of seconds.
      */
-    class BehaviorSwitcher : public RequestHandler {
+    class BehaviorSwitcher {
       Ticker ticker;
 
       public:
@@ -276,77 +2847,239 @@ class ConfigBehavior : public IBehavior {
           });
         }
 
-        bool canHandle(HTTPMethod method, String uri) override {
+        void requested() {
           ticker.detach();
-          return false;
         }
     };
 
+    BehaviorSwitcher behaviorSwitcher;
+    enum UpdateTarget : uint8_t {UPDATE_FIRMWARE, UPDATE_FS, UPDATE_BUNDLE};
+
+    // settings survive a filesystem image update
+    static constexpr PGM_P KEPT_FILES[] = {CONFIG_FILE, NETWORKS_FILE, SCHEDULE_FILE};
+
     ESP8266WebServer webServer;
-    ESP8266HTTPUpdateServer updateServer;
+    UpdateTarget updateTarget = UPDATE_FIRMWARE;
+    ImageWriter imageWriter;
+    FsImageWriter fsImageWriter;
+    BundleWriter bundleWriter;
+    EffectUpload effectUpload;
+    String keptFiles[sizeof KEPT_FILES / sizeof *KEPT_FILES];
     DNSServer dnsServer;
     bool initialized = false;
 
+    static String readFile(PGM_P path) {
+      File file = flashStore.open(path);
+      String content = file ? file.readString() : String();
+      file.close();
+      return content;
+    }
+
+
+    void beginUpdate() {
+      String target = webServer.arg(F("target"));
+      String md5 = webServer.arg(F("md5"));
+      const char *checksum = md5.length() == 32 ? md5.c_str() : nullptr;
+      if (target == F("fs")) {
+        updateTarget = UPDATE_FS;
+        fsImageWriter.begin(checksum);
+      } else if (target == F("bundle")) {
+        updateTarget = UPDATE_BUNDLE;
+        bundleWriter.begin();
+      } else {
+        updateTarget = UPDATE_FIRMWARE;
+        imageWriter.begin((ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000, U_FLASH, checksum);
+      }
+    }
+
+    /*
+     * Images come as the raw request body, so there's no multipart parsing
+     * and each received buffer goes to the flash writer as is. A filesystem
+     * image is staged and verified before it replaces the whole partition,
+     * the settings are written back after. A bundle replaces just the files
+     * it has.
+     */
+    void receiveUpdate(HTTPRaw &raw) {
+      switch (raw.status) {
+        case RAW_START:
+          beginUpdate();
+          break;
+        case RAW_WRITE:
+          if (updateTarget == UPDATE_BUNDLE) {
+            bundleWriter.write(raw.buf, raw.currentSize);
+          } else if (updateTarget == UPDATE_FS) {
+            fsImageWriter.write(raw.buf, raw.currentSize);
+          } else {
+            imageWriter.write(raw.buf, raw.currentSize);
+          }
+          break;
+        case RAW_END:
+          if (updateTarget == UPDATE_BUNDLE) {
+            bundleWriter.end();
+          } else if (updateTarget == UPDATE_FS) {
+            endFsUpdate();
+          } else {
+            imageWriter.end();
+          }
+          break;
+        case RAW_ABORTED:
+          bundleWriter.abort();
+          fsImageWriter.abort();
+          imageWriter.abort();
+          break;
+      }
+    }
+
+    void endFsUpdate() {
+      for (uint8_t i = 0; i < sizeof KEPT_FILES / sizeof *KEPT_FILES; ++i) {
+        keptFiles[i] = readFile(KEPT_FILES[i]);
+      }
+      LittleFS.end();
+      fsImageWriter.end();
+      // an interrupted copy leaves a filesystem which gets formatted here
+      LittleFS.begin();
+      flashStore.reload();
+      for (uint8_t i = 0; i < sizeof KEPT_FILES / sizeof *KEPT_FILES; ++i) {
+        if (keptFiles[i].length()) {
+          flashStore.write(KEPT_FILES[i], keptFiles[i]);
+        }
+        keptFiles[i] = String();
+      }
+    }
+
   public:
-    ConfigBehavior(Context &context) {
+    ConfigBehavior(Context &context) : behaviorSwitcher(context) {
       uint8_t apMacAddr[WL_MAC_ADDR_LENGTH];
       WiFi.softAPmacAddress(apMacAddr);
       char ssid[16];
       sprintf_P(ssid, PSTR("NixieClock %02X%02X"), apMacAddr[0], apMacAddr[1]);
+      // a quick scan in STA mode to find a quiet channel
+      WiFi.mode(WIFI_STA);
+      int8_t networksFound = WiFi.scanNetworks(false, true);
+      metrics.apChannel = selectApChannel(WiFi, networksFound, metrics.apChannelScore);
+      WiFi.scanDelete();
       // make sure only AP mode is enabled
       WiFi.mode(WIFI_AP);
-      if (!WiFi.softAP(ssid, FPSTR(NIXIECLOCK))) {
+      if (!WiFi.softAP(ssid, FPSTR(NIXIECLOCK), metrics.apChannel)) {
         return;
       }
 
-      webServer.addHandler(new BehaviorSwitcher(context));
-      // overrides ESP8266HTTPUpdateServer GET route, because we have custom UI
-      // must be added before calling updateServer.setup()
-      webServer.on(F("/update"), HTTP_GET, [&]() {
-        webServer.send_P(404, MIME_TYPE_TEXT, PSTR("Not found: /update"));
+      auto router = new Router<sizeof CONFIG_ROUTES / sizeof *CONFIG_ROUTES>(CONFIG_ROUTE_TABLE);
+      webServer.addHandler(router);
+      router->onRequest([&]() {
+        behaviorSwitcher.requested();
       });
-      String settingsPath = F("/settings");
-      webServer.on(settingsPath, HTTP_GET, [&]() {
-        String jsonStr;
-        File configFile = LittleFS.open(FPSTR(CONFIG_FILE), "r");
-        if (configFile) {
-          StaticJsonDocument<250> jsonDoc;
-          for (int i = 0; i < CONFIG_KEYS_COUNT && configFile.available(); ++i) {
-            ConfigKey key;
-            memcpy_P(&key, &CONFIG_KEYS[i], sizeof key);
-            jsonDoc[key.name] = readNextValue(configFile);
+      router->on(HTTP_POST, "/update", [&]() {
+        if (updateTarget == UPDATE_BUNDLE) {
+          if (bundleWriter.isDone()) {
+            webServer.send_P(200, MIME_TYPE_TEXT, PSTR("Update Success!"));
+          } else {
+            webServer.send(500, FPSTR(MIME_TYPE_TEXT), bundleWriter.getError());
           }
-          configFile.close();
-          serializeJson(jsonDoc, jsonStr);
-        } else {
-          jsonStr = F("{}");
+          return;
+        }
+        if (updateTarget == UPDATE_FS && !fsImageWriter.isDone()) {
+          webServer.send(500, FPSTR(MIME_TYPE_TEXT), fsImageWriter.getError());
+          return;
+        }
+        if (updateTarget == UPDATE_FIRMWARE && !imageWriter.isDone()) {
+          webServer.send(500, FPSTR(MIME_TYPE_TEXT), imageWriter.getError());
+          return;
+        }
+        webServer.send_P(200, MIME_TYPE_TEXT, PSTR("Update Success! Rebooting..."));
+        delay(100);
+        webServer.client().stop();
+        ESP.restart();
+      }, [&](HTTPRaw &raw) {
+        receiveUpdate(raw);
+      });
+      router->on(HTTP_GET, "/settings", [&]() {
+        sendSettings(webServer, true);
+      });
+      router->on(HTTP_POST, "/settings", [&]() {
+        storeSettings(webServer);
+      });
+      router->on(HTTP_GET, "/networks", [&]() {
+        KnownNetworks networks;
+        networks.load();
+        DynamicJsonDocument jsonDoc(160 * KnownNetworks::MAX_COUNT);
+        for (uint8_t i = 0; i < networks.size(); ++i) {
+          JsonObject network = jsonDoc.createNestedObject();
+          network[F("ssid")] = networks[i].ssid;
+          network[F("priority")] = networks[i].priority;
+          network[F("rssi")] = networks[i].rssi;
+          network[F("channel")] = networks[i].channel;
         }
+        String jsonStr;
+        serializeJson(jsonDoc, jsonStr);
         webServer.send(200, FPSTR(MIME_TYPE_JSON), jsonStr);
       });
-      webServer.on(settingsPath, HTTP_POST, [&]() {
-        File configFile = LittleFS.open(FPSTR(CONFIG_FILE), "w+");
-        if (configFile) {
-          for (int i = 0; i < CONFIG_KEYS_COUNT; ++i) {
-            ConfigKey key;
-            memcpy_P(&key, &CONFIG_KEYS[i], sizeof key);
-            configFile.println(webServer.arg(key.name));
-          }
-          configFile.close();
-
+      router->on(HTTP_POST, "/networks", [&]() {
+        String ssid = webServer.arg(F("ssid"));
+        String psk = webServer.arg(F("ssid-psk"));
+        String priorityArg = webServer.arg(F("priority"));
+        // the lowest if not given
+        uint32_t priority = 0;
+        if (!isValidSetting(CONFIG_SSID, ssid) || !isValidSetting(CONFIG_SSID_PSK, psk)
+            || (priorityArg.length() && !parseUnsigned(priorityArg.c_str(), 255, priority))) {
+          webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Invalid network"));
+          return;
+        }
+        KnownNetworks networks;
+        networks.load();
+        if (!networks.put(ssid, psk, priority)) {
+          webServer.send_P(400, MIME_TYPE_TEXT, PSTR("Too many networks"));
+        } else if (networks.save()) {
+          webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
+        } else {
+          webServer.send_P(500, MIME_TYPE_TEXT, PSTR("Couldn't write networks file"));
+        }
+      });
+      router->on(HTTP_DELETE, "/networks", [&]() {
+        KnownNetworks networks;
+        networks.load();
+        if (!networks.remove(webServer.arg(F("ssid")))) {
+          webServer.send_P(404, MIME_TYPE_TEXT, PSTR("Unknown network"));
+        } else if (networks.save()) {
           webServer.send_P(200, MIME_TYPE_TEXT, PSTR("OK"));
         } else {
-          webServer.send_P(500, MIME_TYPE_TEXT, PSTR("Couldn't write config file"));
+          webServer.send_P(500, MIME_TYPE_TEXT, PSTR("Couldn't write networks file"));
         }
       });
+      router->on(HTTP_GET, "/metrics", [&]() {
+        String jsonStr;
+        metrics.toJson(jsonStr);
+        webServer.send(200, FPSTR(MIME_TYPE_JSON), jsonStr);
+      });
+      router->on(HTTP_PUT, "/effects", [&]() {
+        effectUpload.respond(webServer);
+      }, [&](HTTPRaw &raw) {
+        effectUpload.receive(webServer, raw);
+      });
+#ifdef NIXIECLOCK_TIMELINE
+      router->on(HTTP_GET, "/timeline", [&]() {
+        StreamString timeline;
+        display.dumpTimeline(timeline);
+        webServer.send(200, FPSTR(MIME_TYPE_TEXT), timeline);
+      });
+#endif
+#ifdef NIXIECLOCK_HEAPDUMP
+      router->on(HTTP_GET, "/heap", [&]() {
+        HeapSnapshot snapshot;
+        snapshot.take();
+        snapshot.send(webServer);
+      });
+#endif
+      webServer.addHandler(new AssetGuard());
       webServer.serveStatic("/", LittleFS, "/", "max-age=86400");
 
       dnsServer.setTTL(300);
       // it's OK if DNS server can't start - IP should do fine
       dnsServer.start(53, FPSTR(NIXIECLOCK), WiFi.softAPIP());
 
-      updateServer.setup(&webServer);
-
       webServer.begin();
+      // keep-alive responses are small writes, don't let Nagle hold them back
+      webServer.getServer().setNoDelay(true);
 
       initialized = true;
     }
@@ -369,12 +3102,16 @@ Context context;
 
 void setup()
 {
+  display.begin();
   if (LittleFS.begin()) {
+    flashStore.begin();
     context.setBehavior(new ConfigBehavior(context));
   }
 }
 
 void loop()
 {
+  metrics.sample();
   context.doLoop();
+  flashStore.doLoop();
 }
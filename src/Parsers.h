@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PARSERS_H
+#define PARSERS_H
+
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Calendar.h"
+
+#ifndef ARDUINO
+// host builds keep constants in RAM like everything else
+#define PROGMEM
+#define FPSTR(p) (p)
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strncmp_P strncmp
+#endif
+
+const char MONTHS[] PROGMEM = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+inline bool isDecimal(char c) {
+  return c >= '0' && c <= '9';
+}
+
+inline uint16_t parseNumber(const char *digits, uint8_t count) {
+  uint16_t value = 0;
+  while (count--) {
+    value = value * 10 + (*digits++ - '0');
+  }
+  return value;
+}
+
+// value is decimal digits only, at most max
+inline bool parseUnsigned(const char *str, uint32_t max, uint32_t &value) {
+  size_t length = strlen(str);
+  if (!length || length > 9) {
+    return false;
+  }
+  uint32_t parsed = 0;
+  for (; *str; ++str) {
+    if (!isDecimal(*str)) {
+      return false;
+    }
+    parsed = parsed * 10 + (*str - '0');
+  }
+  if (parsed > max) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+// RFC7231 date is "Tue, 15 Nov 1994 08:12:31 GMT", returns 0 if it isn't one
+inline time_t parseRFC7231Date(const char *str) {
+  if (strlen(str) != 29 || str[3] != ',' || str[4] != ' ' || str[7] != ' ' || str[11] != ' '
+      || str[16] != ' ' || str[19] != ':' || str[22] != ':' || strcmp(str + 25, " GMT")) {
+    return 0;
+  }
+  for (uint8_t i : {5, 6, 12, 13, 14, 15, 17, 18, 20, 21, 23, 24}) {
+    if (!isDecimal(str[i])) {
+      return 0;
+    }
+  }
+  uint8_t month = 0;
+  while (month < 12 && strncmp_P(str + 8, MONTHS + month * 3, 3)) {
+    ++month;
+  }
+  uint16_t year = parseNumber(str + 12, 4);
+  uint8_t day = parseNumber(str + 5, 2);
+  uint8_t hour = parseNumber(str + 17, 2);
+  uint8_t minute = parseNumber(str + 20, 2);
+  // 60 is a leap second
+  uint8_t second = parseNumber(str + 23, 2);
+  // a 32-bit time_t ends in 2038
+  if (month == 12 || year < 1970 || year > 2037 || day < 1 || day > daysInMonth(year, month + 1)
+      || hour > 23 || minute > 59 || second > 60) {
+    return 0;
+  }
+  return daysFromCivil(year, month + 1, day) * SECS_PER_DAY
+    + hour * SECS_PER_HOUR + minute * SECS_PER_MIN + second;
+}
+
+// tz is a ±hh:mm offset
+inline bool parseTzOffset(const char *tz, int32_t &offset) {
+  if (strlen(tz) != 6 || (tz[0] != '+' && tz[0] != '-') || tz[3] != ':'
+      || !isDecimal(tz[1]) || !isDecimal(tz[2]) || !isDecimal(tz[4]) || !isDecimal(tz[5])) {
+    return false;
+  }
+  uint8_t hours = parseNumber(tz + 1, 2);
+  uint8_t minutes = parseNumber(tz + 4, 2);
+  if (hours > 14 || minutes > 59) {
+    return false;
+  }
+  offset = hours * SECS_PER_HOUR + minutes * SECS_PER_MIN;
+  if (tz[0] == '-') {
+    offset = -offset;
+  }
+  return true;
+}
+
+// user asset names are [a-z0-9_-], up to 16 chars
+inline bool isAssetName(const char *name) {
+  size_t length = strlen(name);
+  if (!length || length > 16) {
+    return false;
+  }
+  for (; *name; ++name) {
+    if (!(*name >= 'a' && *name <= 'z') && !isDecimal(*name) && *name != '-' && *name != '_') {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline int8_t parseHexDigit(char c) {
+  if (isDecimal(c)) {
+    return c - '0';
+  }
+  c |= 0x20;
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/*
+ * Hints of a known network are "rssi,channel,bssid" with BSSID in 12 hex
+ * digits. All of them are zeroed if any is malformed, the network is then
+ * picked by a scan instead.
+ */
+inline bool parseNetworkHints(const char *hints, int8_t &rssi, uint8_t &channel, uint8_t (&bssid)[6]) {
+  rssi = 0;
+  channel = 0;
+  memset(bssid, 0, sizeof bssid);
+
+  int parsedRssi, parsedChannel, bssidAt = 0;
+  if (sscanf(hints, "%d,%d,%n", &parsedRssi, &parsedChannel, &bssidAt) != 2 || !bssidAt
+      || parsedRssi < -128 || parsedRssi > 0 || parsedChannel < 0 || parsedChannel > 14
+      || strlen(hints + bssidAt) != 2 * sizeof bssid) {
+    return false;
+  }
+  uint8_t parsedBssid[sizeof bssid];
+  for (uint8_t i = 0; i < sizeof bssid; ++i) {
+    int8_t high = parseHexDigit(hints[bssidAt + 2 * i]);
+    int8_t low = parseHexDigit(hints[bssidAt + 2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    parsedBssid[i] = high << 4 | low;
+  }
+  rssi = parsedRssi;
+  channel = parsedChannel;
+  memcpy(bssid, parsedBssid, sizeof bssid);
+  return true;
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef RADIO_POWER_H
+#define RADIO_POWER_H
+
+#include <stdint.h>
+
+// subsystems needing the network, see RadioPower
+enum RadioUser : uint8_t {
+  RADIO_SYNC,
+  RADIO_MANAGEMENT,
+  RADIO_UPDATE,
+  RADIO_USERS_COUNT
+};
+
+// sleep modes RadioPower picks from
+enum RadioSleep : uint8_t {
+  RADIO_MODEM_SLEEP,
+  RADIO_AWAKE,
+  RADIO_SLEEPS_COUNT
+};
+
+// DTIM periods skipped in modem sleep
+const uint8_t RADIO_LISTEN_INTERVAL = 10;
+
+struct RadioStats {
+  // nominal ESP8266 current draw per sleep mode, mA; modem sleep includes
+  // waking up for every RADIO_LISTEN_INTERVAL-th beacon
+  static constexpr uint16_t CURRENT[RADIO_SLEEPS_COUNT] = {16, 70};
+
+  uint32_t userMillis[RADIO_USERS_COUNT];
+  uint32_t sleepMillis[RADIO_SLEEPS_COUNT];
+
+  // time spent in the sleep modes
+  uint32_t totalMillis() const {
+    return sleepMillis[RADIO_MODEM_SLEEP] + sleepMillis[RADIO_AWAKE];
+  }
+
+  // charge drawn over that time, mAh
+  float energyEstimate() const {
+    return (float(sleepMillis[RADIO_MODEM_SLEEP]) * CURRENT[RADIO_MODEM_SLEEP]
+      + float(sleepMillis[RADIO_AWAKE]) * CURRENT[RADIO_AWAKE]) / 3600000;
+  }
+};
+
+/*
+ * Picks the radio sleep mode from what the subsystems need the network for.
+ * Ones which need it only occasionally, e.g. management, are served in modem
+ * sleep with a long listen interval, the ones doing actual work get the radio
+ * fully awake. The management server listens all the time, so the radio is
+ * never turned off. The time spent in each mode and by each user is counted
+ * in RadioStats.
+ *
+ * Radio tells the time with millis() and switches the mode with
+ * setSleep(RadioSleep).
+ */
+template <typename Radio>
+class RadioPower {
+    Radio radio;
+    RadioStats &stats;
+    uint8_t users = 0;
+    uint8_t activeUsers = 0;
+    // set on construction, so the counting starts from a known mode
+    RadioSleep sleep = RADIO_AWAKE;
+    uint32_t sampledAt;
+
+    void apply() {
+      RadioSleep newSleep = activeUsers ? RADIO_AWAKE : RADIO_MODEM_SLEEP;
+      if (newSleep != sleep) {
+        sleep = newSleep;
+        radio.setSleep(sleep);
+      }
+    }
+
+  public:
+    RadioPower(Radio radio, RadioStats &stats) : radio(radio), stats(stats), sampledAt(radio.millis()) {
+      this->radio.setSleep(sleep);
+    }
+
+    // active users need low latency, the others can live with modem sleep
+    void setNeeded(RadioUser user, bool needed, bool active = true) {
+      uint8_t mask = 1 << user;
+      uint8_t newUsers = needed ? users | mask : users & ~mask;
+      uint8_t newActiveUsers = needed && active ? activeUsers | mask : activeUsers & ~mask;
+      if (newUsers != users || newActiveUsers != activeUsers) {
+        sample();
+        users = newUsers;
+        activeUsers = newActiveUsers;
+        apply();
+      }
+    }
+
+    void sample() {
+      uint32_t ms = radio.millis();
+      uint32_t elapsed = ms - sampledAt;
+      for (uint8_t user = 0; user < RADIO_USERS_COUNT; ++user) {
+        if (users & (1 << user)) {
+          stats.userMillis[user] += elapsed;
+        }
+      }
+      stats.sleepMillis[sleep] += elapsed;
+      sampledAt = ms;
+    }
+
+    RadioSleep getSleep() const {
+      return sleep;
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ROAMING_POLICY_H
+#define ROAMING_POLICY_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * When RoamingMonitor scans and where it roams to. Tracks RSSI with an EWMA
+ * sampled every SAMPLE_MILLIS, so a single bad reading doesn't trigger a
+ * scan, and while it's weak wants a scan every SCAN_MILLIS. Roams only to
+ * a BSSID stronger than the EWMA by MARGIN, so two similar APs don't take
+ * turns.
+ */
+class RoamingPolicy {
+  public:
+    static const uint32_t SAMPLE_MILLIS = 5000;
+    static const uint32_t SCAN_MILLIS = 300000;
+    static const int8_t WEAK_RSSI = -70;
+    // dB another BSSID has to be stronger by
+    static const int8_t MARGIN = 8;
+    static const uint8_t BSSID_LENGTH = 6;
+
+  private:
+    // dBm * 16, 0 until the first sample
+    int16_t rssiEwma = 0;
+    uint32_t sampledAt = 0;
+    uint32_t scannedAt = 0;
+
+  public:
+    // starts over, e.g. on a new association
+    void reset() {
+      rssiEwma = 0;
+    }
+
+    bool isSampleDue(uint32_t ms) const {
+      return ms - sampledAt >= SAMPLE_MILLIS;
+    }
+
+    void sample(int8_t rssi, uint32_t ms) {
+      sampledAt = ms;
+      int16_t value = rssi * 16;
+      // alpha is 1/8
+      rssiEwma = rssiEwma ? rssiEwma + (value - rssiEwma) / 8 : value;
+    }
+
+    // true once per SCAN_MILLIS while the signal is weak
+    bool scanDue(uint32_t ms) {
+      if (rssiEwma && rssiEwma < WEAK_RSSI * 16 && ms - scannedAt >= SCAN_MILLIS) {
+        scannedAt = ms;
+        return true;
+      }
+      return false;
+    }
+
+    /*
+     * The network to roam to, -1 if none is worth it. Scan has SSID(i),
+     * BSSID(i) and RSSI(i) of the networks found, as WiFi does.
+     */
+    template <typename Scan>
+    int8_t select(Scan &scan, int8_t networksFound, const char *ssid, const uint8_t *bssid) const {
+      int8_t best = -1;
+      for (int8_t i = 0; i < networksFound; ++i) {
+        if (!strcmp(scan.SSID(i).c_str(), ssid) && memcmp(scan.BSSID(i), bssid, BSSID_LENGTH)
+            && (best < 0 || scan.RSSI(i) > scan.RSSI(best))) {
+          best = i;
+        }
+      }
+      return best >= 0 && scan.RSSI(best) * 16 > rssiEwma + MARGIN * 16 ? best : -1;
+    }
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ROUTE_TABLE_H
+#define ROUTE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The method is an HTTPMethod, kept as a byte so that tests build without
+ * ESP8266WebServer. Requests to a secured route must be authenticated before
+ * the route's handlers get them.
+ */
+struct Route {
+  uint8_t method;
+  const char *path;
+  bool secured;
+};
+
+constexpr uint32_t hashRoute(uint32_t seed, uint8_t method, const char *path) {
+  // FNV-1a, seeded
+  uint32_t hash = (2166136261u ^ seed ^ method) * 16777619u;
+  for (; *path; ++path) {
+    hash = (hash ^ uint8_t(*path)) * 16777619u;
+  }
+  // low bits of FNV depend on low bits of the seed only, so the slot would
+  // only take as many values as there are slots: MurmurHash3's finalizer
+  // mixes all of the bits into them
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// a power of 2, at least 4 times the routes count
+constexpr size_t routeSlotsFor(size_t routesCount) {
+  size_t slots = 1;
+  while (slots < 4 * routesCount) {
+    slots <<= 1;
+  }
+  return slots;
+}
+
+/*
+ * A perfect hash over (method, path) of the routes. Declared constexpr, the
+ * seed and the slots are found at compile time, so a lookup costs one hash
+ * and one comparison. Check isPerfect() in a static_assert next to the
+ * declaration, a duplicate route never gets a slot of its own.
+ */
+template <size_t N>
+class RouteTable {
+    static_assert(N > 0 && N < 255, "A route index must fit a slot");
+
+    static constexpr size_t SLOTS_COUNT = routeSlotsFor(N);
+
+    Route routes[N];
+    // route index + 1, 0 for an empty slot
+    uint8_t slots[SLOTS_COUNT];
+    // 0 if none of the candidates worked
+    uint32_t seed;
+
+  public:
+    // with 3/4 of the slots empty a seed works once in 10 tries for 16
+    // routes, once in 80 for 32
+    static constexpr uint32_t MAX_SEEDS = 4096;
+
+    constexpr RouteTable(const Route (&routes)[N]) : routes(), slots(), seed(0) {
+      for (size_t i = 0; i < N; ++i) {
+        this->routes[i] = routes[i];
+      }
+      for (uint32_t candidate = 1; candidate <= MAX_SEEDS && !seed; ++candidate) {
+        for (size_t slot = 0; slot < SLOTS_COUNT; ++slot) {
+          slots[slot] = 0;
+        }
+        bool placed = true;
+        for (size_t i = 0; i < N && placed; ++i) {
+          size_t slot = hashRoute(candidate, routes[i].method, routes[i].path) & (SLOTS_COUNT - 1);
+          placed = !slots[slot];
+          slots[slot] = i + 1;
+        }
+        if (placed) {
+          seed = candidate;
+        }
+      }
+    }
+
+    constexpr bool isPerfect() const {
+      return seed != 0;
+    }
+
+    const Route &operator[](uint8_t i) const {
+      return routes[i];
+    }
+
+    // returns index of the route or -1
+    int8_t find(uint8_t method, const char *path) const {
+      uint8_t slot = slots[hashRoute(seed, method, path) & (SLOTS_COUNT - 1)];
+      if (slot && routes[slot - 1].method == method && !strcmp(routes[slot - 1].path, path)) {
+        return slot - 1;
+      }
+      return -1;
+    }
+};
+
+#endif
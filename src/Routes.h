@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ROUTES_H
+#define ROUTES_H
+
+#ifdef ARDUINO
+#include <ESP8266WebServer.h>
+#else
+// as ESP8266WebServer's HTTPMethod
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+#endif
+
+#include "RouteTable.h"
+
+// the clock is on a shared network: whatever changes it is secured, as is
+// the heap, which has bits of the secrets in it
+constexpr Route CLOCKS_ROUTES[] = {
+  {HTTP_GET, "/settings", false},
+  {HTTP_POST, "/settings", true},
+  {HTTP_GET, "/metrics", false},
+  {HTTP_PUT, "/effects", true},
+  {HTTP_POST, "/effects", true},
+  {HTTP_DELETE, "/effects", true},
+  {HTTP_POST, "/timer", true},
+  {HTTP_GET, "/schedule", false},
+  {HTTP_POST, "/schedule", true},
+  {HTTP_DELETE, "/schedule", true},
+  {HTTP_POST, "/messages", true},
+#ifdef NIXIECLOCK_TIMELINE
+  {HTTP_GET, "/timeline", false},
+#endif
+#ifdef NIXIECLOCK_HEAPDUMP
+  {HTTP_GET, "/heap", true},
+#endif
+};
+constexpr RouteTable<sizeof CLOCKS_ROUTES / sizeof *CLOCKS_ROUTES> CLOCKS_ROUTE_TABLE(CLOCKS_ROUTES);
+static_assert(CLOCKS_ROUTE_TABLE.isPerfect(), "CLOCKS_ROUTES has a duplicate or no seed fits it, raise RouteTable::MAX_SEEDS");
+
+// config mode runs an AP of its own, whoever joined it is trusted
+constexpr Route CONFIG_ROUTES[] = {
+  {HTTP_POST, "/update", false},
+  {HTTP_GET, "/settings", false},
+  {HTTP_POST, "/settings", false},
+  {HTTP_GET, "/networks", false},
+  {HTTP_POST, "/networks", false},
+  {HTTP_DELETE, "/networks", false},
+  {HTTP_GET, "/metrics", false},
+  {HTTP_PUT, "/effects", false},
+#ifdef NIXIECLOCK_TIMELINE
+  {HTTP_GET, "/timeline", false},
+#endif
+#ifdef NIXIECLOCK_HEAPDUMP
+  {HTTP_GET, "/heap", false},
+#endif
+};
+constexpr RouteTable<sizeof CONFIG_ROUTES / sizeof *CONFIG_ROUTES> CONFIG_ROUTE_TABLE(CONFIG_ROUTES);
+static_assert(CONFIG_ROUTE_TABLE.isPerfect(), "CONFIG_ROUTES has a duplicate or no seed fits it, raise RouteTable::MAX_SEEDS");
+
+#endif
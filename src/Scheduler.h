@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Calendar.h"
+#include "Parsers.h"
+
+/*
+ * Recurring events, e.g. an alarm playing an animation on weekdays at 7:00,
+ * an hourly chime or a nightly cathode cleaning. Rules are stored as
+ * "days,hour,minute,action,name" lines, where days is a mask of week days,
+ * Sunday first, and hour is EVERY_HOUR for hourly events.
+ *
+ * The next occurrence of each rule sits in a min-heap keyed by local time,
+ * so checking for a due event is a look at the heap top and firing one is
+ * a pop and a push. Occurrences are worked out lazily, one per rule, and
+ * always after the one last fired: when a DST change repeats an hour, its
+ * events don't fire twice, and when one skips an hour, they fire once the
+ * clock is past them.
+ */
+class Scheduler {
+  public:
+    enum Action : uint8_t {
+      ACTION_ANIMATION, ACTION_EFFECT, ACTION_CATHODE_CLEANING, ACTION_UPDATE_CHECK, ACTIONS_COUNT
+    };
+
+    struct Rule {
+      uint8_t days;
+      uint8_t hour;
+      uint8_t minute;
+      Action action;
+      // an animation or an effect
+      char name[17];
+    };
+
+    static const uint8_t MAX_RULES = 32;
+    static const uint8_t EVERY_HOUR = 0xFF;
+
+  private:
+    struct Event {
+      time_t at;
+      uint8_t rule;
+    };
+
+    Rule rules[MAX_RULES];
+    time_t lastFired[MAX_RULES];
+    uint8_t count = 0;
+    Event heap[MAX_RULES];
+    uint8_t heapSize = 0;
+    // local time the heap was built or last checked at
+    time_t checkedAt = 0;
+
+    // the first occurrence strictly after the given local time, 0 if none
+    static time_t nextOccurrence(const Rule &rule, time_t after) {
+      time_t day = after - after % SECS_PER_DAY;
+      for (uint8_t i = 0; i < 8; ++i, day += SECS_PER_DAY) {
+        // 1970-01-01 was a Thursday
+        if (!(rule.days & 1 << (day / SECS_PER_DAY + 4) % 7)) {
+          continue;
+        }
+        if (rule.hour != EVERY_HOUR) {
+          time_t at = day + rule.hour * SECS_PER_HOUR + rule.minute * SECS_PER_MIN;
+          if (at > after) {
+            return at;
+          }
+          continue;
+        }
+        for (uint8_t hour = 0; hour < 24; ++hour) {
+          time_t at = day + hour * SECS_PER_HOUR + rule.minute * SECS_PER_MIN;
+          if (at > after) {
+            return at;
+          }
+        }
+      }
+      return 0;
+    }
+
+    void push(uint8_t rule, time_t after) {
+      time_t at = nextOccurrence(rules[rule], after);
+      if (!at) {
+        return;
+      }
+      uint8_t i = heapSize++;
+      for (; i > 0 && heap[(i - 1) / 2].at > at; i = (i - 1) / 2) {
+        heap[i] = heap[(i - 1) / 2];
+      }
+      heap[i] = {at, rule};
+    }
+
+    void pop() {
+      Event last = heap[--heapSize];
+      uint8_t i = 0;
+      for (uint8_t child = 1; child < heapSize; i = child, child = 2 * i + 1) {
+        if (child + 1 < heapSize && heap[child + 1].at < heap[child].at) {
+          ++child;
+        }
+        if (last.at <= heap[child].at) {
+          break;
+        }
+        heap[i] = heap[child];
+      }
+      heap[i] = last;
+    }
+
+  public:
+    static bool isValid(const Rule &rule) {
+      return rule.days && rule.days < 1 << 7 && (rule.hour < 24 || rule.hour == EVERY_HOUR)
+        && rule.minute < 60 && rule.action < ACTIONS_COUNT
+        && (rule.action == ACTION_CATHODE_CLEANING || rule.action == ACTION_UPDATE_CHECK || isAssetName(rule.name));
+    }
+
+    // a stored line, false unless it's a valid rule
+    static bool parse(const char *line, Rule &rule) {
+      int values[4];
+      int nameAt = 0;
+      if (sscanf(line, "%d,%d,%d,%d,%n", &values[0], &values[1], &values[2], &values[3], &nameAt) < 4
+          || !nameAt || strlen(line + nameAt) >= sizeof rule.name
+          || values[0] < 0 || values[0] > 0xFF || values[1] < 0 || values[1] > 0xFF
+          || values[2] < 0 || values[2] > 0xFF || values[3] < 0 || values[3] >= ACTIONS_COUNT) {
+        return false;
+      }
+      rule.days = values[0];
+      rule.hour = values[1];
+      rule.minute = values[2];
+      rule.action = Action(values[3]);
+      strcpy(rule.name, line + nameAt);
+      return isValid(rule);
+    }
+
+    uint8_t size() const {
+      return count;
+    }
+
+    const Rule &operator[](uint8_t i) const {
+      return rules[i];
+    }
+
+    void clear() {
+      count = 0;
+      heapSize = 0;
+    }
+
+    bool add(const Rule &rule) {
+      if (count == MAX_RULES || !isValid(rule)) {
+        return false;
+      }
+      lastFired[count] = 0;
+      rules[count++] = rule;
+      heapSize = 0;
+      return true;
+    }
+
+    bool remove(uint8_t i) {
+      if (i >= count) {
+        return false;
+      }
+      --count;
+      for (; i < count; ++i) {
+        rules[i] = rules[i + 1];
+        lastFired[i] = lastFired[i + 1];
+      }
+      heapSize = 0;
+      return true;
+    }
+
+    /*
+     * Returns the index of a rule due at the given local time, -1 if none is.
+     * Called until it returns -1, the heap is (re)built when rules changed or
+     * the clock went back.
+     */
+    int8_t due(time_t localTime) {
+      if ((!heapSize && count) || localTime < checkedAt) {
+        heapSize = 0;
+        for (uint8_t i = 0; i < count; ++i) {
+          push(i, std::max(localTime - 1, lastFired[i]));
+        }
+      }
+      checkedAt = localTime;
+      if (!heapSize || heap[0].at > localTime) {
+        return -1;
+      }
+      uint8_t rule = heap[0].rule;
+      lastFired[rule] = heap[0].at;
+      pop();
+      push(rule, std::max(localTime, lastFired[rule]));
+      return rule;
+    }
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Parsers.h"
+
+// secret values are only shown in config mode, to whoever joined its AP
+typedef struct { char name[9]; bool secret; } ConfigKey;
+const uint8_t CONFIG_KEYS_COUNT = 5;
+const ConfigKey CONFIG_KEYS[CONFIG_KEYS_COUNT] PROGMEM = {
+  {"ssid", false}, {"ssid-psk", true}, {"api-key", true}, {"tz", false}, {"ota-url", false}
+};
+// indexes of CONFIG_KEYS
+enum ConfigKeyIndex : uint8_t {
+  CONFIG_SSID, CONFIG_SSID_PSK, CONFIG_API_KEY, CONFIG_TZ, CONFIG_OTA_URL
+};
+
+// what's to be done about changed settings
+enum SettingsAction : uint8_t {
+  SETTINGS_RECONNECT = 1 << 0,
+  SETTINGS_SYNC = 1 << 1,
+  SETTINGS_GEOLOCATE = 1 << 2,
+  // a fixed tz offset, applied right away
+  SETTINGS_TZ_OFFSET = 1 << 3,
+  SETTINGS_UPDATER = 1 << 4
+};
+
+/*
+ * Reads the next value of a settings file. Values are println()-ed, so each
+ * ends with "\r\n". Value is the string type to read into, e.g. String.
+ */
+template <typename Value, typename Stream>
+Value readSettingsValue(Stream &file) {
+  Value value;
+  bool cr = false;
+  for (int c; (c = file.read()) >= 0 && c != '\n';) {
+    if (cr) {
+      value += '\r';
+    }
+    cr = c == '\r';
+    if (!cr) {
+      value += char(c);
+    }
+  }
+  return value;
+}
+
+// sets the first count settings in a JSON document, secrets only if asked for
+template <typename Json, typename Value>
+void settingsToJson(Json &json, const Value (&values)[CONFIG_KEYS_COUNT], uint8_t count, bool withSecrets) {
+  for (uint8_t i = 0; i < count; ++i) {
+    ConfigKey key;
+    memcpy_P(&key, &CONFIG_KEYS[i], sizeof key);
+    if (withSecrets || !key.secret) {
+      json[key.name] = values[i];
+    }
+  }
+}
+
+/*
+ * Bit i is set if values[i] differ. Value is anything comparable, e.g.
+ * String.
+ */
+template <typename Value>
+uint8_t diffSettings(const Value (&values)[CONFIG_KEYS_COUNT], const Value (&other)[CONFIG_KEYS_COUNT]) {
+  uint8_t changed = 0;
+  for (uint8_t i = 0; i < CONFIG_KEYS_COUNT; ++i) {
+    if (!(values[i] == other[i])) {
+      changed |= 1 << i;
+    }
+  }
+  return changed;
+}
+
+/*
+ * Only what changed is applied: a network change reconnects, an API key
+ * needs a sync, tz autodetection geolocates first, which syncs too, a fixed
+ * tz offset needs nothing else, a new update URL is polled.
+ */
+inline uint8_t settingsActions(uint8_t changed, const char *tz) {
+  uint8_t actions = 0;
+  if (changed & (1 << CONFIG_SSID | 1 << CONFIG_SSID_PSK)) {
+    actions |= SETTINGS_RECONNECT;
+  }
+  if (changed & 1 << CONFIG_API_KEY) {
+    actions |= SETTINGS_SYNC;
+  }
+  if (changed & 1 << CONFIG_TZ) {
+    actions |= strcmp(tz, "auto") ? SETTINGS_TZ_OFFSET : SETTINGS_GEOLOCATE;
+  }
+  if (changed & 1 << CONFIG_OTA_URL) {
+    actions |= SETTINGS_UPDATER;
+  }
+  return actions;
+}
+
+#endif
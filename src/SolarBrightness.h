@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SOLAR_BRIGHTNESS_H
+#define SOLAR_BRIGHTNESS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "Calendar.h"
+
+struct Location {
+  double_t lat;
+  double_t lng;
+
+  bool isValid() const {
+    return !(isnan(lat) || isnan(lng));
+  }
+};
+const Location INVALID_LOCATION = {nan("loc"), nan("loc")};
+
+/*
+ * Follows the sun: full brightness by day, dimmed by night and ramped through
+ * civil twilight. Sun events are computed once a day and whenever location
+ * or tz offset change, the duty once a minute.
+ */
+class SolarBrightness {
+  public:
+    static const uint8_t DAY_DUTY = 255;
+    static const uint8_t NIGHT_DUTY = 64;
+
+  private:
+    static const int16_t MINS_PER_DAY = 24 * 60;
+    // sun centre below the horizon, degrees
+    static constexpr float SUNRISE_ZENITH = 90.833;
+    static constexpr float CIVIL_TWILIGHT_ZENITH = 96;
+
+    // minutes since local midnight
+    int16_t dawn, sunrise, sunset, dusk;
+    bool alwaysDay = false;
+    bool alwaysNight = false;
+    time_t computedDay = -1;
+    time_t computedMinute = -1;
+    Location computedLocation = INVALID_LOCATION;
+    int32_t computedTzOffset = 0;
+    uint8_t duty = DAY_DUTY;
+
+    static int16_t since(int16_t from, int16_t to) {
+      return ((to - from) % MINS_PER_DAY + MINS_PER_DAY) % MINS_PER_DAY;
+    }
+
+    static uint8_t ramp(uint8_t from, uint8_t to, int16_t elapsed, int16_t length) {
+      return length ? from + (int16_t(to) - from) * elapsed / length : to;
+    }
+
+    static float toRadians(float degrees) {
+      return degrees * float(M_PI) / 180;
+    }
+
+    // NOAA approximation: half a day of the sun above the given zenith, minutes,
+    // negative if it's never there, above a day if it's always there
+    static float halfDayMinutes(float zenith, float lat, float declination) {
+      float cosHourAngle = (cos(toRadians(zenith)) - sin(lat) * sin(declination)) / (cos(lat) * cos(declination));
+      if (cosHourAngle > 1) {
+        return -1;
+      }
+      if (cosHourAngle < -1) {
+        return MINS_PER_DAY;
+      }
+      // 4 minutes per degree of hour angle
+      return 4 * 180 / float(M_PI) * acos(cosHourAngle);
+    }
+
+    void compute(time_t localTime, const Location &location, int32_t tzOffset) {
+      float gamma = 2 * float(M_PI) / 365 * dayOfYear(localTime / SECS_PER_DAY);
+      float eqTime = 229.18 * (0.000075 + 0.001868 * cos(gamma) - 0.032077 * sin(gamma)
+        - 0.014615 * cos(2 * gamma) - 0.040849 * sin(2 * gamma));
+      float declination = 0.006918 - 0.399912 * cos(gamma) + 0.070257 * sin(gamma)
+        - 0.006758 * cos(2 * gamma) + 0.000907 * sin(2 * gamma)
+        - 0.002697 * cos(3 * gamma) + 0.00148 * sin(3 * gamma);
+      float lat = toRadians(location.lat);
+      int16_t noon = lround(720 - 4 * location.lng - eqTime + tzOffset / 60);
+
+      float dayHalf = halfDayMinutes(SUNRISE_ZENITH, lat, declination);
+      float twilightHalf = halfDayMinutes(CIVIL_TWILIGHT_ZENITH, lat, declination);
+      alwaysDay = dayHalf >= MINS_PER_DAY / 2;
+      // polar night, twilight at noon at most
+      alwaysNight = dayHalf < 0;
+      if (twilightHalf >= MINS_PER_DAY / 2) {
+        // white night, twilight lasts till solar midnight
+        twilightHalf = MINS_PER_DAY / 2;
+      }
+      sunrise = since(0, noon - lround(dayHalf));
+      sunset = since(0, noon + lround(dayHalf));
+      dawn = since(0, noon - lround(twilightHalf));
+      dusk = since(0, noon + lround(twilightHalf));
+    }
+
+  public:
+    // duty to show the given local time with, all the tubes lit if the location is unknown
+    uint8_t dutyAt(time_t localTime, const Location &location, int32_t tzOffset) {
+      if (!location.isValid()) {
+        return DAY_DUTY;
+      }
+      bool moved = location.lat != computedLocation.lat || location.lng != computedLocation.lng
+        || tzOffset != computedTzOffset;
+      time_t minute = localTime / SECS_PER_MIN;
+      if (minute == computedMinute && !moved) {
+        return duty;
+      }
+      computedMinute = minute;
+      time_t day = localTime / SECS_PER_DAY;
+      if (day != computedDay || moved) {
+        computedDay = day;
+        computedLocation = location;
+        computedTzOffset = tzOffset;
+        compute(localTime, location, tzOffset);
+      }
+
+      int16_t now = minute % MINS_PER_DAY;
+      if (alwaysDay) {
+        duty = DAY_DUTY;
+      } else if (alwaysNight) {
+        duty = NIGHT_DUTY;
+      } else if (since(sunrise, now) < since(sunrise, sunset)) {
+        duty = DAY_DUTY;
+      } else if (since(dawn, now) < since(dawn, sunrise)) {
+        duty = ramp(NIGHT_DUTY, DAY_DUTY, since(dawn, now), since(dawn, sunrise));
+      } else if (since(sunset, now) < since(sunset, dusk)) {
+        duty = ramp(DAY_DUTY, NIGHT_DUTY, since(sunset, now), since(sunset, dusk));
+      } else {
+        duty = NIGHT_DUTY;
+      }
+      return duty;
+    }
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SYNC_SCHEDULE_H
+#define SYNC_SCHEDULE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "Calendar.h"
+
+/*
+ * When ClocksBehavior syncs the time and how far off the clock was, by the
+ * board's millis. TimeLib calls the sync provider INTERVAL_SECS after the
+ * last attempt, failed or not, and the radio is woken up WAKE_AHEAD_MILLIS
+ * before that, to have time to reconnect. In between the time is the synced
+ * one plus the whole seconds since, as TimeLib's now() counts them, so the
+ * board's crystal drift adds up until the next sync.
+ */
+class SyncSchedule {
+  public:
+    static const uint32_t INTERVAL_SECS = SECS_PER_DAY;
+    static const uint32_t WAKE_AHEAD_MILLIS = 60000;
+
+  private:
+    time_t syncTime = 0;
+    uint32_t syncMillis = 0;
+    uint32_t attemptMillis = 0;
+    bool attempted = false;
+    bool synced = false;
+
+  public:
+    bool isSynced() const {
+      return synced;
+    }
+
+    // when TimeLib calls the sync provider, for simulations
+    bool isSyncTime(uint32_t ms) const {
+      return !attempted || ms - attemptMillis >= INTERVAL_SECS * 1000;
+    }
+
+    // true from WAKE_AHEAD_MILLIS before a sync, or until the first one
+    bool isSyncDue(uint32_t ms) const {
+      return !synced || ms - attemptMillis >= INTERVAL_SECS * 1000 - WAKE_AHEAD_MILLIS;
+    }
+
+    void failed(uint32_t ms) {
+      attempted = true;
+      attemptMillis = ms;
+    }
+
+    // returns seconds the clock was off right before the sync, 0 for the first one
+    int32_t succeeded(time_t time, uint32_t ms) {
+      int32_t error = synced ? time - timeAt(ms) : 0;
+      syncTime = time;
+      syncMillis = ms;
+      synced = true;
+      attempted = true;
+      attemptMillis = ms;
+      return error;
+    }
+
+    // what the clock shows, UTC
+    time_t timeAt(uint32_t ms) const {
+      return syncTime + (ms - syncMillis) / 1000;
+    }
+};
+
+#endif
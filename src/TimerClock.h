@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TIMER_CLOCK_H
+#define TIMER_CLOCK_H
+
+#include <stdint.h>
+
+#include "Calendar.h"
+
+/*
+ * Countdown and stopwatch time. The shown time is worked out from a
+ * monotonic microseconds clock each time it's read rather than counted up,
+ * so jitter of the reads never adds up and clock syncs, which may step the
+ * wall time, don't touch a running timer. That clock is the board's
+ * crystal, so a timer is off by its tolerance, some tens of ppm, which
+ * syncs don't correct. Shows SS.cc under a minute, MM:SS under 100 minutes
+ * and HH:MM after that; a finished countdown flashes 00.00 for a while.
+ */
+class TimerClock {
+  public:
+    enum Mode : uint8_t {COUNTDOWN, STOPWATCH};
+
+    // K155ID1 blanks its outputs for any BCD code above 9
+    static const uint8_t BLANK = 0x0F;
+    static constexpr uint64_t FLASH_MICROS = 30000000;
+    static constexpr uint64_t FLASH_PERIOD_MICROS = 250000;
+
+    struct Face {
+      uint8_t digits[4];
+      bool dot;
+    };
+
+  private:
+    Mode mode;
+    uint64_t durationMicros;
+    // elapsed before the last resume
+    uint64_t elapsedMicros = 0;
+    uint64_t resumedAt;
+    bool running = true;
+
+    uint64_t elapsed(uint64_t nowMicros) const {
+      return elapsedMicros + (running ? nowMicros - resumedAt : 0);
+    }
+
+    static Face faceOf(uint32_t centis, bool lit) {
+      uint32_t secs = centis / 100;
+      uint8_t high, low;
+      bool dot;
+      if (secs < 60) {
+        high = secs;
+        low = centis % 100;
+        dot = true;
+      } else if (secs < 100 * SECS_PER_MIN) {
+        high = secs / SECS_PER_MIN;
+        low = secs % SECS_PER_MIN;
+        dot = centis % 100 < 50;
+      } else {
+        uint32_t hours = secs / SECS_PER_HOUR;
+        high = hours > 99 ? 99 : hours;
+        low = secs / SECS_PER_MIN % 60;
+        dot = centis % 100 < 50;
+      }
+      Face face;
+      face.digits[0] = lit ? high / 10 : BLANK;
+      face.digits[1] = lit ? high % 10 : BLANK;
+      face.digits[2] = lit ? low / 10 : BLANK;
+      face.digits[3] = lit ? low % 10 : BLANK;
+      face.dot = lit && dot;
+      return face;
+    }
+
+  public:
+    TimerClock(Mode mode, uint32_t durationSecs, uint64_t nowMicros)
+        : mode(mode), durationMicros(uint64_t(durationSecs) * 1000000), resumedAt(nowMicros) {}
+
+    void pause(uint64_t nowMicros) {
+      if (running) {
+        elapsedMicros = elapsed(nowMicros);
+        running = false;
+      }
+    }
+
+    void resume(uint64_t nowMicros) {
+      if (!running) {
+        resumedAt = nowMicros;
+        running = true;
+      }
+    }
+
+    // a countdown finishes once it's done flashing
+    bool isFinished(uint64_t nowMicros) const {
+      return mode == COUNTDOWN && elapsed(nowMicros) >= durationMicros + FLASH_MICROS;
+    }
+
+    Face faceAt(uint64_t nowMicros) const {
+      uint64_t elapsedNow = elapsed(nowMicros);
+      if (mode == STOPWATCH) {
+        return faceOf(elapsedNow / 10000, true);
+      }
+      if (elapsedNow < durationMicros) {
+        // rounded up, the countdown shows 00.00 only once it's over
+        return faceOf((durationMicros - elapsedNow + 9999) / 10000, true);
+      }
+      return faceOf(0, (elapsedNow - durationMicros) / FLASH_PERIOD_MICROS % 2 == 0);
+    }
+};
+
+#endif
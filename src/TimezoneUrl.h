@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TIMEZONE_URL_H
+#define TIMEZONE_URL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Parsers.h"
+#include "SolarBrightness.h"
+
+const char TIMEZONE_API_URL[] PROGMEM = "https://maps.googleapis.com/maps/api/timezone/json?key=";
+// "&location=-90.00,-180.00&timestamp=4294967295"
+const size_t TIMEZONE_QUERY_LENGTH = 64;
+
+/*
+ * The timezone API URL getTime() requests with the API key. Room for the
+ * location query is reserved as well, so the URL is allocated once. Url
+ * is the string type, e.g. String.
+ */
+template <typename Url>
+void timezoneUrl(Url &url, const char *apiKey) {
+  url.reserve(strlen_P(TIMEZONE_API_URL) + strlen(apiKey) + TIMEZONE_QUERY_LENGTH);
+  url += FPSTR(TIMEZONE_API_URL);
+  url += apiKey;
+}
+
+// appends the location and the time to look the offsets up for
+template <typename Url>
+void appendTimezoneQuery(Url &url, const Location &location, time_t time) {
+  char query[TIMEZONE_QUERY_LENGTH];
+  snprintf(query, sizeof query, "&location=%.2f,%.2f&timestamp=%lu",
+           location.lat, location.lng, (unsigned long) time);
+  url += query;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017-2019 Leonid Bogdanov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <string.h>
+
+// what the portal loads, a bundle may bring more of the same kinds
+const char *const WEB_ASSET_EXTENSIONS[] = {".htm", ".css", ".js", ".ico", ".png", ".svg"};
+
+/*
+ * Whether a path may be served as a static file. The filesystem has the
+ * settings, known networks with their PSKs, the schedule and pending bundle
+ * files next to the assets, none of which is anyone's business. "/" is the
+ * portal page, a gzipped asset is served for its plain name.
+ */
+inline bool isWebAsset(const char *path) {
+  if (!strcmp(path, "/")) {
+    return true;
+  }
+  if (path[0] != '/' || strchr(path + 1, '/')) {
+    return false;
+  }
+  size_t length = strlen(path);
+  if (length > 3 && !strcmp(path + length - 3, ".gz")) {
+    length -= 3;
+  }
+  for (const char *extension : WEB_ASSET_EXTENSIONS) {
+    size_t extensionLength = strlen(extension);
+    if (length > extensionLength + 1 && !strncmp(path + length - extensionLength, extension, extensionLength)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif
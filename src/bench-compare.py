@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+"""
+Compares two runs of the host benchmarks:
+
+    pio test -e bench -v > before.txt
+    ... change something ...
+    pio test -e bench -v > after.txt
+    bench-compare.py before.txt after.txt
+
+Benchmarks print a JSON line each, everything else in the output is
+skipped. Exits with 1 if a benchmark got slower by more than --threshold
+percent or allocates more than it did.
+"""
+
+from __future__ import print_function
+import argparse
+import json
+import sys
+
+
+def read_run(path):
+    """Maps benchmark names to their results."""
+    results = {}
+    with open(path) as f:
+        for line in f:
+            start = line.find('{"benchmark"')
+            if start >= 0:
+                result = json.loads(line[start:])
+                results[result["benchmark"]] = result
+    if not results:
+        raise ValueError("%s: no benchmarks" % path)
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10, help="slowdown to fail on, percent")
+    args = parser.parse_args()
+    try:
+        baseline = read_run(args.baseline)
+        current = read_run(args.current)
+    except (ValueError, IOError) as e:
+        print(e)
+        return 1
+
+    regressed = False
+    print("%-28s %10s %10s %8s %8s %8s" % ("benchmark", "ns", "+ns", "+%", "allocs", "+allocs"))
+    for name in sorted(set(baseline) | set(current)):
+        if name not in current:
+            print("%-28s %10s" % (name, "gone"))
+            continue
+        ns, allocs = current[name]["ns"], current[name]["allocs"]
+        if name not in baseline:
+            print("%-28s %10.2f %10s %8s %8.3f %8s" % (name, ns, "new", "", allocs, ""))
+            continue
+        base_ns, base_allocs = baseline[name]["ns"], baseline[name]["allocs"]
+        change = 100.0 * (ns - base_ns) / base_ns if base_ns else 0
+        worse = change > args.threshold or allocs > base_allocs
+        regressed |= worse
+        print("%-28s %10.2f %+10.2f %+7.1f%% %8.3f %+8.3f%s" % (
+            name, ns, ns - base_ns, change, allocs, allocs - base_allocs, "  <<" if worse else ""))
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,55 @@
+#!/usr/bin/env python
+"""
+Packs web assets into a bundle, to update them through the portal without
+replacing the whole filesystem.
+
+A bundle is "NXB1" followed by files, each a path length byte, the path, a
+little endian uint32 size, the MD5 of the content and the content. Files are
+stored at the filesystem root under their base names.
+"""
+
+from __future__ import print_function
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+MAGIC = b"NXB1"
+MAX_FILES = 8
+MAX_PATH_LENGTH = 27
+SETTINGS_FILES = ("/config.cfg", "/networks.cfg", "/schedule.cfg")
+
+
+def pack(paths):
+    bundle = [MAGIC]
+    for path in paths:
+        name = "/" + os.path.basename(path)
+        if len(name) > MAX_PATH_LENGTH or name in SETTINGS_FILES:
+            raise ValueError("can't bundle " + name)
+        with open(path, "rb") as f:
+            content = f.read()
+        bundle.append(struct.pack("<B", len(name)) + name.encode())
+        bundle.append(struct.pack("<I", len(content)) + hashlib.md5(content).digest())
+        bundle.append(content)
+    return b"".join(bundle)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("output")
+    parser.add_argument("files", nargs="+", help="e.g. index.htm.gz chota.css.gz")
+    args = parser.parse_args()
+    if len(args.files) > MAX_FILES:
+        print("At most %d files fit a bundle" % MAX_FILES)
+        return 1
+
+    bundle = pack(args.files)
+    with open(args.output, "wb") as f:
+        f.write(bundle)
+    print("%s: %d files, %d bytes" % (args.output, len(args.files), len(bundle)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
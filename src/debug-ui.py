@@ -14,8 +14,18 @@ def root():
 
 @app.route("/update", methods=["POST"])
 def update():
-    response = "Update Success" if request.files else "Update Error"
-    return (response, 200)
+    if not request.get_data():
+        return ("No image", 500)
+    if request.args.get("target") == "bundle":
+        return ("Update Success!", 200)
+    return ("Update Success! Rebooting...", 200)
+
+
+@app.route("/effects", methods=["PUT"])
+def put_effect():
+    effect = request.get_data()
+    valid = request.args.get("name") and effect and len(effect) % 4 == 0
+    return ("OK", 200) if valid else ("Invalid effect", 400)
 
 
 @app.route("/settings", methods=["GET"])
@@ -24,7 +34,8 @@ def get_settings():
         "ssid": "WiFi SSID",
         "ssid-psk": "abc",
         "api-key": "123",
-        "tz": "+01:00"
+        "tz": "+01:00",
+        "ota-url": "http://192.168.1.2:8000/manifest.json"
     }
     return jsonify(settings)
 
@@ -35,5 +46,70 @@ def save_settings():
     return ("Success", 200) if request.form['ssid'] else ("Error", 400)
 
 
+@app.route("/networks", methods=["GET"])
+def get_networks():
+    networks = [
+        {"ssid": "Office", "priority": 2, "rssi": -61, "channel": 6},
+        {"ssid": "Home", "priority": 1, "rssi": -48, "channel": 11}
+    ]
+    return jsonify(networks)
+
+
+@app.route("/networks", methods=["POST"])
+def save_network():
+    print(request.form)
+    return ("OK", 200) if request.form['ssid'] else ("Invalid network", 400)
+
+
+@app.route("/networks", methods=["DELETE"])
+def delete_network():
+    print(request.args)
+    return ("OK", 200)
+
+
+@app.route("/metrics", methods=["GET"])
+def get_metrics():
+    metrics = {
+        "uptime": 3600,
+        "syncs": 1,
+        "sync-failures": 0,
+        "display-error-secs": 0,
+        "flash-writes": 1,
+        "flash-bytes-written": 42,
+        "files": {
+            "/config.cfg": {"writes": 1, "suppressed": 2, "bytes": 42, "erases": 2}
+        },
+        "radio-modem-sleep-secs": 3450,
+        "radio-awake-secs": 150,
+        "radio-sync-secs": 120,
+        "radio-management-secs": 3600,
+        "radio-update-secs": 30,
+        "network-selection-ms": 2150,
+        "roams": 0,
+        "ap-channel": 6,
+        "ap-channel-score": 40,
+        "boosted-secs": 12,
+        "tls-requests": 3,
+        "tls-avg-ms": 1800,
+        "updates": 1,
+        "update-kbps": 38,
+        "update-verify-ms": 12,
+        "effect-frames": 6000,
+        "effect-avg-ipf": 28,
+        "effect-max-ipf": 28,
+        "effect-preemptions": 0,
+        "animation-frames": 1200,
+        "animation-underruns": 0,
+        "messages-shown": 12,
+        "messages-expired": 1,
+        "messages-dropped": 0,
+        "message-max-latency-ms": 4950,
+        "commands-rejected": 0,
+        "energy-mah": 18.3,
+        "free-heap": 30000
+    }
+    return jsonify(metrics)
+
+
 if __name__ == "__main__":
     app.run(host='0.0.0.0', debug=True)
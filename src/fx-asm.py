@@ -0,0 +1,281 @@
+#!/usr/bin/env python
+"""
+Assembles a tube effect for the clock's effect VM, optionally running it to
+see how many instructions its frames take.
+
+One instruction per line, operands separated by commas, ";" starts a
+comment and "name:" defines a label which jumps may target:
+
+    ; counts 0-9 on every tube, a digit a second
+        ldi r1, 100
+    next:
+        frame r0
+        div r0, r0, r1
+        ldi r2, 10
+        mod r0, r0, r2
+        ldi r3, 0
+    tube:
+        digit r3, r0
+        addi r3, r3, 1
+        ldi r4, 4
+        slt r4, r3, r4
+        jnz r4, tube
+        yield
+        jmp next
+
+Upload the result with
+curl --digest -u nixieclock:<api key> -X PUT --data-binary @effect.fx 'http://<clock>/effects?name=count'
+and play it with
+curl --digest -u nixieclock:<api key> -X POST 'http://<clock>/effects?name=count'.
+In config mode the clock takes uploads without credentials.
+"""
+
+from __future__ import print_function
+import argparse
+import os
+import re
+import struct
+import sys
+
+# must match EffectVM
+REGISTERS_COUNT = 8
+MAX_INSTRUCTIONS = 256
+FUEL = 200
+FRAMES_PER_SEC = 100
+TUBES_COUNT = 4
+BLANK = 0x0F
+
+# opcode, operands: r is a register, i a 16-bit immediate, b an 8-bit one, l a label
+OPCODES = [
+    ("halt", ""),
+    ("ldi", "ri"),
+    ("mov", "rr"),
+    ("add", "rrr"),
+    ("sub", "rrr"),
+    ("mul", "rrr"),
+    ("div", "rrr"),
+    ("mod", "rrr"),
+    ("addi", "rrb"),
+    ("slt", "rrr"),
+    ("jmp", "l"),
+    ("jz", "rl"),
+    ("jnz", "rl"),
+    ("digit", "rr"),
+    ("duty", "rr"),
+    ("dot", "r"),
+    ("frame", "r"),
+    ("clock", "r"),
+    ("yield", ""),
+    ("wait", "r"),
+]
+OPCODE_INDEXES = {name: i for i, (name, _) in enumerate(OPCODES)}
+
+
+class AssemblyError(Exception):
+    pass
+
+
+def parse_number(text, low, high):
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise AssemblyError("not a number: " + text)
+    if not low <= value <= high:
+        raise AssemblyError("out of range: " + text)
+    return value
+
+
+def assemble(source):
+    """Returns instructions as (opcode, [a, b, c]) tuples."""
+    lines = []
+    labels = {}
+    for number, line in enumerate(source.splitlines(), 1):
+        line = line.split(";")[0].strip()
+        match = re.match(r"(\w+):\s*(.*)$", line)
+        if match:
+            labels[match.group(1)] = len(lines)
+            line = match.group(2)
+        if line:
+            lines.append((number, line))
+
+    program = []
+    for number, line in lines:
+        mnemonic, _, operands = line.partition(" ")
+        operands = [operand.strip() for operand in operands.split(",") if operand.strip()]
+        try:
+            if mnemonic.lower() not in OPCODE_INDEXES:
+                raise AssemblyError("unknown instruction: " + mnemonic)
+            opcode = OPCODE_INDEXES[mnemonic.lower()]
+            kinds = OPCODES[opcode][1]
+            if len(operands) != len(kinds):
+                raise AssemblyError("%s takes %d operands" % (mnemonic, len(kinds)))
+            fields = []
+            for kind, operand in zip(kinds, operands):
+                if kind == "r":
+                    if not re.match(r"r\d$", operand) or int(operand[1:]) >= REGISTERS_COUNT:
+                        raise AssemblyError("not a register: " + operand)
+                    fields.append(int(operand[1:]))
+                elif kind == "b":
+                    fields.append(parse_number(operand, -128, 127) & 0xFF)
+                else:
+                    if kind == "l":
+                        if operand not in labels:
+                            raise AssemblyError("unknown label: " + operand)
+                        value = labels[operand]
+                    else:
+                        value = parse_number(operand, -32768, 32767)
+                    fields += [value & 0xFF, (value >> 8) & 0xFF]
+        except AssemblyError as e:
+            raise AssemblyError("line %d: %s" % (number, e))
+        program.append((opcode, (fields + [0, 0, 0])[:3]))
+
+    if len(program) > MAX_INSTRUCTIONS:
+        raise AssemblyError("%d instructions, at most %d fit" % (len(program), MAX_INSTRUCTIONS))
+    return program
+
+
+def encode(program):
+    return b"".join(struct.pack("<4B", opcode, *fields) for opcode, fields in program)
+
+
+def to_int32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def truncating_div(a, b):
+    quotient = abs(a) // abs(b)
+    return quotient if (a < 0) == (b < 0) else -quotient
+
+
+class Machine(object):
+    """Runs a program the way EffectVM does, frame by frame."""
+
+    def __init__(self, program):
+        self.program = program
+        self.pc = 0
+        self.r = [0] * REGISTERS_COUNT
+        self.frames = 0
+        self.wait_frames = 0
+        self.running = True
+        self.digits = [BLANK] * TUBES_COUNT
+        self.duty = [255] * TUBES_COUNT
+        self.dot = False
+
+    def run_frame(self, secs_of_day):
+        """Returns instructions executed and whether the frame was preempted."""
+        executed = 0
+        preempted = False
+        if self.wait_frames:
+            self.wait_frames -= 1
+        else:
+            executed, preempted = self.execute(secs_of_day)
+        self.frames += 1
+        return executed, preempted
+
+    def execute(self, secs_of_day):
+        r = self.r
+        executed = 0
+        while self.running:
+            if executed == FUEL:
+                return executed, True
+            if self.pc >= len(self.program):
+                self.running = False
+                break
+            opcode, (a, b, c) = self.program[self.pc]
+            name = OPCODES[opcode][0]
+            imm = struct.unpack("<h", struct.pack("<2B", b, c))[0]
+            self.pc += 1
+            executed += 1
+            if name == "halt":
+                self.running = False
+            elif name == "ldi":
+                r[a] = imm
+            elif name == "mov":
+                r[a] = r[b]
+            elif name in ("add", "sub", "mul"):
+                r[a] = to_int32({"add": r[b] + r[c], "sub": r[b] - r[c], "mul": r[b] * r[c]}[name])
+            elif name in ("div", "mod"):
+                if not r[c]:
+                    self.running = False
+                else:
+                    quotient = truncating_div(r[b], r[c])
+                    r[a] = to_int32(quotient if name == "div" else r[b] - quotient * r[c])
+            elif name == "addi":
+                r[a] = to_int32(r[b] + struct.unpack("<b", struct.pack("<B", c))[0])
+            elif name == "slt":
+                r[a] = int(r[b] < r[c])
+            elif name == "jmp":
+                self.pc = imm
+            elif name == "jz":
+                if not r[a]:
+                    self.pc = imm
+            elif name == "jnz":
+                if r[a]:
+                    self.pc = imm
+            elif name == "digit":
+                if 0 <= r[a] < TUBES_COUNT:
+                    self.digits[r[a]] = r[b] if 0 <= r[b] <= 9 else BLANK
+            elif name == "duty":
+                if 0 <= r[a] < TUBES_COUNT:
+                    self.duty[r[a]] = min(max(r[b], 0), 255)
+            elif name == "dot":
+                self.dot = bool(r[a])
+            elif name == "frame":
+                r[a] = to_int32(self.frames)
+            elif name == "clock":
+                r[a] = secs_of_day
+            elif name == "wait":
+                self.wait_frames = max(r[a], 0)
+                return executed, False
+            elif name == "yield":
+                return executed, False
+        return executed, False
+
+
+def bench(program, frames):
+    machine = Machine(program)
+    counts = []
+    preemptions = 0
+    for frame in range(frames):
+        if not machine.running:
+            break
+        executed, preempted = machine.run_frame(43200 + frame // FRAMES_PER_SEC)
+        counts.append(executed)
+        preemptions += preempted
+    print("%d frames at %d Hz, %s" % (len(counts), FRAMES_PER_SEC,
+                                       "running" if machine.running else "halted"))
+    if counts:
+        print("instructions per frame: avg %.1f, max %d, fuel %d" % (
+            float(sum(counts)) / len(counts), max(counts), FUEL))
+        print("instructions per second: %d" % (sum(counts) * FRAMES_PER_SEC // len(counts)))
+    print("preempted frames: %d" % preemptions)
+    return preemptions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source")
+    parser.add_argument("-o", "--output", help="defaults to the source with .fx extension")
+    parser.add_argument("--bench", type=int, metavar="FRAMES",
+                        help="runs the effect for this many frames and reports instructions per frame")
+    args = parser.parse_args()
+
+    with open(args.source) as f:
+        try:
+            program = assemble(f.read())
+        except AssemblyError as e:
+            print("%s: %s" % (args.source, e))
+            return 1
+    output = args.output or os.path.splitext(args.source)[0] + ".fx"
+    with open(output, "wb") as f:
+        f.write(encode(program))
+    print("%s: %d instructions" % (output, len(program)))
+
+    if args.bench:
+        bench(program, args.bench)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
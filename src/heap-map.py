@@ -0,0 +1,165 @@
+#!/usr/bin/env python
+"""
+Shows how fragmented a heap snapshot is and what takes the heap.
+
+Snapshots are served by /heap when the firmware is built with
+-D NIXIECLOCK_HEAPDUMP:
+
+    curl --digest -u nixieclock:<api key> -o week.heap http://<clock>/heap
+
+In config mode the clock serves it without credentials.
+
+Used runs of blocks are grouped by their tag, the first word of the
+allocation. Given the firmware ELF, tags which point at a vtable are shown
+as the class of the object; tags which look like text are likely String
+buffers and are grouped by their first characters. Pass an earlier snapshot
+as --baseline to see which groups grew in between.
+"""
+
+from __future__ import print_function
+import argparse
+import collections
+import re
+import struct
+import subprocess
+import sys
+
+
+def read_snapshot(path):
+    """Returns the header fields and the runs, as (block, blocks, used, tag) tuples."""
+    with open(path) as f:
+        lines = [line.strip() for line in f if line.strip()]
+    fields = lines[0].split(",")
+    if fields[0] != "heap":
+        raise ValueError("%s: not a heap snapshot" % path)
+    header = {
+        "address": int(fields[1], 16),
+        "block_size": int(fields[2]),
+        "own_block": int(fields[3]),
+        "truncated": fields[4] == "1",
+    }
+    runs = []
+    for line in lines[1:]:
+        block, blocks, kind, tag = line.split(",")
+        runs.append((int(block), int(blocks), kind == "u", int(tag, 16)))
+    return header, runs
+
+
+def read_symbols(nm, elf):
+    """Returns (address, size, name) of sized symbols, sorted by address."""
+    output = subprocess.check_output([nm, "-S", "-C", elf]).decode()
+    symbols = []
+    for line in output.splitlines():
+        match = re.match(r"([0-9a-f]+) ([0-9a-f]+) \w (.+)$", line)
+        if match:
+            address, size, name = match.groups()
+            symbols.append((int(address, 16), int(size, 16), name))
+    return sorted(symbols)
+
+
+def symbol_at(symbols, address):
+    low, high = 0, len(symbols)
+    while low < high:
+        middle = (low + high) // 2
+        if symbols[middle][0] <= address:
+            low = middle + 1
+        else:
+            high = middle
+    if low and address < symbols[low - 1][0] + symbols[low - 1][1]:
+        return symbols[low - 1][2]
+    return None
+
+
+def group_of(tag, symbols, header, heap_size):
+    name = symbol_at(symbols, tag)
+    if name:
+        return name.replace("vtable for ", "object ")
+    text = struct.pack("<I", tag)
+    if all(0x20 <= c < 0x7F for c in bytearray(text)):
+        return 'text "%s"' % text.decode()
+    if header["address"] <= tag < header["address"] + heap_size:
+        return "pointer into heap"
+    return "other"
+
+
+def groups(header, runs, symbols):
+    """Maps groups of used runs to their count and bytes."""
+    heap_size = sum(blocks for _, blocks, _, _ in runs) * header["block_size"]
+    totals = collections.defaultdict(lambda: [0, 0])
+    for block, blocks, used, tag in runs:
+        if used and block != header["own_block"]:
+            total = totals[group_of(tag, symbols, header, heap_size)]
+            total[0] += 1
+            total[1] += blocks * header["block_size"]
+    return totals
+
+
+def print_summary(header, runs):
+    block_size = header["block_size"]
+    free = [blocks * block_size for _, blocks, used, _ in runs if not used]
+    used = [blocks * block_size for block, blocks, is_used, _ in runs if is_used and block != header["own_block"]]
+    largest = max(free) if free else 0
+    print("heap at %08x: %d runs%s" % (header["address"], len(runs), ", truncated" if header["truncated"] else ""))
+    print("used %d bytes in %d runs, free %d bytes in %d runs" % (sum(used), len(used), sum(free), len(free)))
+    print("largest free %d bytes, fragmentation %d%%" % (
+        largest, 100 - 100 * largest // sum(free) if free else 0))
+    print("free runs by size:")
+    buckets = collections.Counter(1 << (size.bit_length() - 1) for size in free)
+    for size in sorted(buckets):
+        print("  %6d-%-6d %4d" % (size, size * 2 - 1, buckets[size]))
+
+
+def print_map(header, runs, width, blocks_per_char):
+    """A character per blocks_per_char blocks: # used, . free, + both, S the snapshot itself."""
+    cells = []
+    for block, blocks, used, _ in runs:
+        mark = "S" if block == header["own_block"] else "#" if used else "."
+        cells += [mark] * blocks
+    line = []
+    for i in range(0, len(cells), blocks_per_char):
+        marks = set(cells[i:i + blocks_per_char])
+        line.append(marks.pop() if len(marks) == 1 else "S" if "S" in marks else "+")
+    print("map, %d bytes per character:" % (blocks_per_char * header["block_size"]))
+    for i in range(0, len(line), width):
+        print("  %08x %s" % (header["address"] + i * blocks_per_char * header["block_size"], "".join(line[i:i + width])))
+
+
+def print_groups(totals, baseline):
+    print("used by group:")
+    print("  %6s %8s %7s %9s  %s" % ("runs", "bytes", "+runs", "+bytes", "group"))
+    for name, (count, size) in sorted(totals.items(), key=lambda item: -item[1][1]):
+        base_count, base_size = baseline.get(name, (0, 0))
+        print("  %6d %8d %+7d %+9d  %s" % (count, size, count - base_count, size - base_size, name))
+    for name in sorted(set(baseline) - set(totals)):
+        print("  %6d %8d %+7d %+9d  %s" % (0, 0, -baseline[name][0], -baseline[name][1], name))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("snapshot")
+    parser.add_argument("--baseline", help="an earlier snapshot to compare groups with")
+    parser.add_argument("--elf", help="firmware.elf, to name objects by their vtable")
+    parser.add_argument("--nm", default="xtensa-lx106-elf-nm")
+    parser.add_argument("--width", type=int, default=64, help="map characters per line")
+    parser.add_argument("--blocks-per-char", type=int, default=8)
+    args = parser.parse_args()
+
+    symbols = read_symbols(args.nm, args.elf) if args.elf else []
+    try:
+        header, runs = read_snapshot(args.snapshot)
+        baseline = {}
+        if args.baseline:
+            baseline_header, baseline_runs = read_snapshot(args.baseline)
+            baseline = groups(baseline_header, baseline_runs, symbols)
+    except (ValueError, IndexError) as e:
+        print(e)
+        return 1
+
+    print_summary(header, runs)
+    print_map(header, runs, args.width, args.blocks_per_char)
+    print_groups(groups(header, runs, symbols), baseline)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,183 @@
+#!/usr/bin/env python
+"""
+Encodes a tube animation for AnimationPlayer and checks it plays without
+underruns.
+
+The input has a frame per line: four digits, "-" for a blank tube, then
+optionally the brightness of each tube (a single value for all of them or
+four comma separated ones, 0-255) and the dot (0 or 1):
+
+    0000 255 1
+    1111 128,255,255,128 0
+    ----
+
+A frame without brightness keeps the previous one. Consecutive identical
+frames are stored once, with a hold count. Upload the result as
+startup.nxa or hourly.nxa in an asset bundle (see bundle.py).
+"""
+
+from __future__ import print_function
+import argparse
+import struct
+import sys
+
+# must match AnimationPlayer
+MAGIC = b"NXA1"
+HEADER_SIZE = 6
+BUFFER_SIZE = 128
+MIN_FRAME_MILLIS = 10
+TUBES_COUNT = 4
+BLANK = 0x0F
+
+
+def parse_frames(text):
+    frames = []
+    duty = [255] * TUBES_COUNT
+    for number, line in enumerate(text.splitlines(), 1):
+        fields = line.split("#")[0].split()
+        if not fields:
+            continue
+        try:
+            if len(fields[0]) != TUBES_COUNT:
+                raise ValueError("expected %d digits" % TUBES_COUNT)
+            digits = [BLANK if c == "-" else int(c) for c in fields[0]]
+            if len(fields) > 1:
+                duties = [int(value) for value in fields[1].split(",")]
+                duty = duties * TUBES_COUNT if len(duties) == 1 else duties
+                if len(duty) != TUBES_COUNT or not all(0 <= value <= 255 for value in duty):
+                    raise ValueError("bad brightness")
+            dot = len(fields) > 2 and fields[2] == "1"
+        except ValueError as e:
+            raise ValueError("line %d: %s" % (number, e))
+        frames.append((digits, list(duty), dot))
+    return frames
+
+
+def encode(frames, frame_millis):
+    """Returns the file and its records, as (offset, size, frames shown) tuples."""
+    data = bytearray(MAGIC + struct.pack("<H", frame_millis))
+    records = []
+    shown = ([BLANK] * TUBES_COUNT, [255] * TUBES_COUNT, False)
+    i = 0
+    while i < len(frames):
+        digits, duty, dot = frames[i]
+        hold = 0
+        while i + hold + 1 < len(frames) and frames[i + hold + 1] == frames[i] and hold < 255:
+            hold += 1
+        digit_mask = sum(1 << t for t in range(TUBES_COUNT) if digits[t] != shown[0][t])
+        duty_mask = sum(1 << t for t in range(TUBES_COUNT) if duty[t] != shown[1][t])
+        head = digit_mask | (0x10 if duty_mask else 0) | (0x20 if dot else 0) | (0x40 if hold else 0)
+        record = bytearray([head])
+        if duty_mask:
+            record.append(duty_mask)
+        if hold:
+            record.append(hold)
+        record += bytearray(digits[t] for t in range(TUBES_COUNT) if digit_mask & (1 << t))
+        record += bytearray(duty[t] for t in range(TUBES_COUNT) if duty_mask & (1 << t))
+        records.append((len(data), len(record), 1 + hold))
+        data += record
+        shown = frames[i]
+        i += 1 + hold
+    return bytes(data), records
+
+
+class Player(object):
+    """Mirrors AnimationPlayer's buffering, counting reads it had to do while decoding."""
+
+    def __init__(self, data):
+        self.data = data
+        self.offset = HEADER_SIZE
+        self.buffers = [b"", b""]
+        self.current = 0
+        self.position = 0
+        self.underruns = 0
+        self.fill(0)
+        self.fill(1)
+
+    def fill(self, buffer):
+        self.buffers[buffer] = self.data[self.offset:self.offset + BUFFER_SIZE]
+        self.offset += len(self.buffers[buffer])
+
+    def next_byte(self):
+        if self.position == len(self.buffers[self.current]):
+            other = self.current ^ 1
+            if not self.buffers[other]:
+                if self.offset < len(self.data):
+                    self.underruns += 1
+                self.fill(other)
+                if not self.buffers[other]:
+                    return None
+            self.buffers[self.current] = b""
+            self.current = other
+            self.position = 0
+        self.position += 1
+        return self.buffers[self.current][self.position - 1]
+
+    def decode(self, length):
+        for _ in range(length):
+            if self.next_byte() is None:
+                return False
+        return True
+
+    def prefetch(self):
+        if not self.buffers[self.current ^ 1]:
+            self.fill(self.current ^ 1)
+
+
+def simulate(data, records, frame_millis, loop_millis):
+    """
+    Plays the animation as AnimationPlayer does, with loop() running every
+    loop_millis. Returns underruns, reads done while decoding, and late
+    frames, shown a frame interval or more after they were due.
+    """
+    player = Player(data)
+    late_frames = 0
+    due = 0
+    now = 0
+    for _, length, frames in records:
+        while now < due:
+            now += loop_millis
+        player.decode(length)
+        late = now - due
+        if late >= frame_millis:
+            late_frames += 1
+        due = (due if late < frame_millis else now) + frame_millis * frames
+        player.prefetch()
+    # the player finds the end by reading past the last record
+    player.decode(1)
+    return player.underruns, late_frames
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("frames", help="frames, a line each")
+    parser.add_argument("output", help="e.g. startup.nxa")
+    parser.add_argument("--frame-ms", type=int, default=20,
+                        help="frame interval, at least %d ms" % MIN_FRAME_MILLIS)
+    parser.add_argument("--loop-ms", type=int, default=10,
+                        help="loop() period to check playback against")
+    args = parser.parse_args()
+    if args.frame_ms < MIN_FRAME_MILLIS:
+        print("Frames can't be shorter than %d ms" % MIN_FRAME_MILLIS)
+        return 1
+
+    with open(args.frames) as f:
+        try:
+            frames = parse_frames(f.read())
+        except ValueError as e:
+            print("%s: %s" % (args.frames, e))
+            return 1
+    data, records = encode(frames, args.frame_ms)
+    with open(args.output, "wb") as f:
+        f.write(data)
+    raw_size = len(frames) * (TUBES_COUNT * 2 + 1)
+    print("%s: %d frames, %d records, %d bytes (%d uncompressed), %.1f s" % (
+        args.output, len(frames), len(records), len(data), raw_size, len(frames) * args.frame_ms / 1000.0))
+
+    underruns, late_frames = simulate(data, records, args.frame_ms, args.loop_ms)
+    print("with loop() every %d ms: %d underruns, %d late frames" % (args.loop_ms, underruns, late_frames))
+    return 1 if underruns or late_frames else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,49 @@
+#!/usr/bin/env python
+"""
+Sends a timer or message command to the clock over UDP:
+
+    send-command.py --api-key <key> <clock> countdown 300
+    send-command.py --api-key <key> <clock> message 42 5
+
+Datagrams carry the time they were sent at and are signed with the API
+key, the clock drops ones more than a minute off its own time, so the
+sender's clock must be in sync. There's no reply, /metrics counts the
+rejected commands.
+"""
+
+from __future__ import print_function
+import argparse
+import hashlib
+import hmac
+import socket
+import sys
+import time
+
+COMMAND_UDP_PORT = 4210
+
+
+def datagram(api_key, command, millis):
+    message = "%d %s" % (millis, command)
+    signature = hmac.new(api_key.encode(), message.encode(), hashlib.sha256).hexdigest()
+    return ("%s %s" % (message, signature)).encode()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--api-key", required=True)
+    parser.add_argument("--port", type=int, default=COMMAND_UDP_PORT)
+    parser.add_argument("clock")
+    parser.add_argument("command", nargs="+")
+    args = parser.parse_args()
+
+    data = datagram(args.api_key, " ".join(args.command), int(time.time() * 1000))
+    if len(data) > 127:
+        print("Command too long")
+        return 1
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.sendto(data, (args.clock, args.port))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
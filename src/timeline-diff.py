@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+"""
+Compares a display frame timeline against a golden one.
+
+Timelines are "micros,hash,duty..." lines, as served by /timeline when the
+firmware is built with -D NIXIECLOCK_TIMELINE. Frames and duties must match
+exactly, intervals between frame swaps may differ by the given tolerance.
+"""
+
+from __future__ import print_function
+import argparse
+import sys
+
+
+def read_timeline(path):
+    timeline = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                fields = line.split(",")
+                timeline.append((int(fields[0]), fields[1], [int(duty) for duty in fields[2:]]))
+    return timeline
+
+
+def intervals(timeline):
+    return [b[0] - a[0] for a, b in zip(timeline, timeline[1:])]
+
+
+def jitter(timeline):
+    deltas = intervals(timeline)
+    return max(deltas) - min(deltas) if deltas else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("golden")
+    parser.add_argument("actual")
+    parser.add_argument("--tolerance-us", type=int, default=500,
+                        help="allowed difference of an interval between swaps")
+    parser.add_argument("--jitter-us", type=int, default=None,
+                        help="allowed growth of the swap interval spread")
+    args = parser.parse_args()
+
+    golden = read_timeline(args.golden)
+    actual = read_timeline(args.actual)
+    errors = []
+
+    if len(golden) != len(actual):
+        errors.append("frame count: expected %d, got %d" % (len(golden), len(actual)))
+    for i, (expected, got) in enumerate(zip(golden, actual)):
+        if expected[1] != got[1]:
+            errors.append("frame %d: expected hash %s, got %s" % (i, expected[1], got[1]))
+        if expected[2] != got[2]:
+            errors.append("frame %d: expected duty %s, got %s" % (i, expected[2], got[2]))
+    for i, (expected, got) in enumerate(zip(intervals(golden), intervals(actual))):
+        if abs(expected - got) > args.tolerance_us:
+            errors.append("frame %d: expected %dus after previous, got %dus" % (i + 1, expected, got))
+    if args.jitter_us is not None and jitter(actual) - jitter(golden) > args.jitter_us:
+        errors.append("jitter: expected %dus, got %dus" % (jitter(golden), jitter(actual)))
+
+    for error in errors:
+        print(error)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
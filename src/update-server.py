@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+"""
+Serves a firmware image to clocks pulling updates.
+
+/manifest.json describes the image, /firmware.bin serves it, honoring Range
+requests. --drop-after cuts the first image response short, to see that a
+clock resumes the download rather than starting over.
+"""
+
+from __future__ import print_function
+import argparse
+import hashlib
+import json
+import os
+import re
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+except ImportError:
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+
+
+class UpdateHandler(BaseHTTPRequestHandler):
+    image = b""
+    drop_after = None
+
+    def do_GET(self):
+        if self.path == "/manifest.json":
+            host = self.headers.get("Host") or "%s:%d" % self.server.server_address
+            manifest = {
+                "url": "http://%s/firmware.bin" % host,
+                "size": len(self.image),
+                "md5": hashlib.md5(self.image).hexdigest()
+            }
+            self.send_body(200, "application/json", json.dumps(manifest).encode())
+        elif self.path == "/firmware.bin":
+            self.send_image()
+        else:
+            self.send_body(404, "text/plain", b"Not found")
+
+    def send_body(self, code, mime_type, body):
+        self.send_response(code)
+        self.send_header("Content-Type", mime_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def send_image(self):
+        first, last = 0, len(self.image) - 1
+        match = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        if match:
+            first = int(match.group(1))
+            if match.group(2):
+                last = min(int(match.group(2)), last)
+            if first > last:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % len(self.image))
+                self.end_headers()
+                return
+        self.send_response(206 if match else 200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(last - first + 1))
+        if match:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (first, last, len(self.image)))
+        self.end_headers()
+
+        body = self.image[first:last + 1]
+        if UpdateHandler.drop_after is not None and UpdateHandler.drop_after < len(body):
+            body = body[:UpdateHandler.drop_after]
+            UpdateHandler.drop_after = None
+            self.close_connection = True
+        self.wfile.write(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("image", help="firmware.bin as built by PlatformIO")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--drop-after", type=int, default=None,
+                        help="bytes after which the first image response is cut")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        UpdateHandler.image = f.read()
+    UpdateHandler.drop_after = args.drop_after
+    print("Serving %s, %d bytes, manifest at http://<this host>:%d/manifest.json"
+          % (os.path.basename(args.image), len(UpdateHandler.image), args.port))
+    HTTPServer(("", args.port), UpdateHandler).serve_forever()
+
+
+if __name__ == "__main__":
+    main()
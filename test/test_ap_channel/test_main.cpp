@@ -0,0 +1,88 @@
+#include <unity.h>
+
+#include "ApChannel.h"
+
+// scan results as WiFi has them
+struct Scan {
+  struct Network {
+    int32_t rssi;
+    uint8_t channel;
+  };
+
+  const Network *networks;
+
+  int32_t RSSI(uint8_t i) {
+    return networks[i].rssi;
+  }
+
+  uint8_t channel(uint8_t i) {
+    return networks[i].channel;
+  }
+};
+
+template <int8_t N>
+uint8_t selectFor(const Scan::Network (&networks)[N], uint16_t &score) {
+  Scan scan = {networks};
+  return selectApChannel(scan, N, score);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_picks_channel_1_when_quiet() {
+  Scan scan = {nullptr};
+  uint16_t score = 1;
+  TEST_ASSERT_EQUAL(1, selectApChannel(scan, 0, score));
+  TEST_ASSERT_EQUAL(0, score);
+}
+
+void test_prefers_non_overlapping_channels() {
+  uint16_t score;
+  // 1 is taken, 6 and 11 are quiet
+  const Scan::Network one[] = {{-50, 1}};
+  TEST_ASSERT_EQUAL(6, selectFor(one, score));
+  TEST_ASSERT_EQUAL(0, score);
+  // 1 and 6 are taken, 11 is quiet
+  const Scan::Network oneAndSix[] = {{-50, 1}, {-50, 6}};
+  TEST_ASSERT_EQUAL(11, selectFor(oneAndSix, score));
+  TEST_ASSERT_EQUAL(0, score);
+}
+
+void test_avoids_stronger_networks() {
+  uint16_t score;
+  // all of 1, 6 and 11 are taken, the weakest one is shared
+  const Scan::Network networks[] = {{-40, 1}, {-90, 6}, {-40, 11}};
+  TEST_ASSERT_EQUAL(6, selectFor(networks, score));
+  TEST_ASSERT_EQUAL(10, score);
+}
+
+void test_counts_overlapping_channels() {
+  uint16_t score;
+  // 3 and 9 overlap all of 1, 6 and 11 except for 1, by a fifth
+  const Scan::Network networks[] = {{-50, 3}, {-50, 9}};
+  TEST_ASSERT_EQUAL(1, selectFor(networks, score));
+  TEST_ASSERT_EQUAL(30, score);
+  // channels in between overlap two of them as much, 1 wins the tie
+  const Scan::Network crowded[] = {{-30, 1}, {-30, 6}, {-30, 11}};
+  TEST_ASSERT_EQUAL(1, selectFor(crowded, score));
+  TEST_ASSERT_EQUAL(70, score);
+}
+
+void test_clamps_weights_and_channels() {
+  uint16_t score;
+  // a weaker than -100 dBm network counts for nothing, channel 13 only overlaps up to 11
+  const Scan::Network networks[] = {{-120, 1}, {-50, 13}, {10, 6}};
+  TEST_ASSERT_EQUAL(1, selectFor(networks, score));
+  TEST_ASSERT_EQUAL(0, score);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_picks_channel_1_when_quiet);
+  RUN_TEST(test_prefers_non_overlapping_channels);
+  RUN_TEST(test_avoids_stronger_networks);
+  RUN_TEST(test_counts_overlapping_channels);
+  RUN_TEST(test_clamps_weights_and_channels);
+  return UNITY_END();
+}
@@ -0,0 +1,329 @@
+#include <ArduinoJson.h>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unity.h>
+
+#include "Frame.h"
+#include "MessageQueue.h"
+#include "NetworkSelect.h"
+#include "Parsers.h"
+#include "Routes.h"
+#include "Scheduler.h"
+#include "Settings.h"
+#include "SolarBrightness.h"
+#include "TimerClock.h"
+#include "TimezoneUrl.h"
+
+/*
+ * Host benchmarks of the logic NixieClock.cpp runs every loop or every
+ * request, pio test -e bench -v. String is std::string on the host. Each prints a JSON line with the time and
+ * the allocations per call; src/bench-compare.py compares two runs. Host
+ * times don't translate to the ESP8266, their changes between commits do.
+ */
+
+size_t allocations = 0;
+
+void *operator new(size_t size) {
+  ++allocations;
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+// keeps the compiler from dropping a result nobody reads
+template <typename T>
+inline void keep(const T &value) {
+  asm volatile("" : : "m"(value) : "memory");
+}
+
+const std::chrono::milliseconds MIN_TIME(100);
+
+// calls f(i) in batches, doubled until a batch takes MIN_TIME
+template <typename F>
+void bench(const char *name, F f) {
+  for (uint64_t iterations = 1;; iterations *= 2) {
+    allocations = 0;
+    auto startedAt = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+      f(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startedAt;
+    if (elapsed >= MIN_TIME) {
+      double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+      printf("{\"benchmark\": \"%s\", \"iterations\": %llu, \"ns\": %.2f, \"allocs\": %.3f}\n",
+             name, (unsigned long long) iterations, ns, double(allocations) / iterations);
+      return;
+    }
+  }
+}
+
+// routes "/route-<i>", a method each in turn
+template <size_t N>
+struct GeneratedRoutes {
+  char paths[N][16];
+  Route routes[N];
+
+  GeneratedRoutes() {
+    const uint8_t methods[] = {HTTP_GET, HTTP_POST, HTTP_DELETE};
+    for (size_t i = 0; i < N; ++i) {
+      snprintf(paths[i], sizeof paths[i], "/route-%u", unsigned(i));
+      routes[i] = {methods[i % 3], paths[i], false};
+    }
+  }
+};
+
+// RouteTable against the strcmp() scan ESP8266WebServer's handlers do
+template <size_t N>
+void benchRoutes() {
+  static GeneratedRoutes<N> generated;
+  static RouteTable<N> table(generated.routes);
+  TEST_ASSERT_TRUE(table.isPerfect());
+  char name[32];
+  snprintf(name, sizeof name, "route_find/%u", unsigned(N));
+  bench(name, [](uint64_t i) {
+    const Route &route = generated.routes[i % N];
+    keep(table.find(route.method, route.path));
+  });
+  snprintf(name, sizeof name, "route_scan/%u", unsigned(N));
+  bench(name, [](uint64_t i) {
+    const Route &route = generated.routes[i % N];
+    int8_t found = -1;
+    for (size_t j = 0; j < N && found < 0; ++j) {
+      if (generated.routes[j].method == route.method && !strcmp(generated.routes[j].path, route.path)) {
+        found = j;
+      }
+    }
+    keep(found);
+  });
+}
+
+// KnownNetworks::MAX_COUNT networks, as KnownNetworks has them
+struct KnownNetworks {
+  struct Network {
+    std::string ssid;
+    uint8_t priority;
+  };
+
+  Network networks[8];
+
+  int8_t indexOf(const std::string &ssid) const {
+    for (uint8_t i = 0; i < 8; ++i) {
+      if (networks[i].ssid == ssid) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  const Network &operator[](uint8_t i) const {
+    return networks[i];
+  }
+};
+
+// a scan in a block of flats, as WiFi has it
+template <int8_t N>
+struct CrowdedScan {
+  std::string ssids[N];
+  int32_t rssis[N];
+
+  CrowdedScan() {
+    for (int8_t i = 0; i < N; ++i) {
+      ssids[i] = "neighbor-" + std::to_string(i);
+      rssis[i] = -40 - i * 37 % 50;
+    }
+    ssids[N / 3] = "home";
+    ssids[N * 2 / 3] = "home";
+  }
+
+  const std::string &SSID(int8_t i) {
+    return ssids[i];
+  }
+
+  int32_t RSSI(int8_t i) {
+    return rssis[i];
+  }
+};
+
+// a file read from RAM, as Settings::load() reads CONFIG_FILE
+struct MemoryFile {
+  const char *data;
+  size_t position;
+
+  int read() {
+    return data[position] ? data[position++] : -1;
+  }
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+// read through volatile pointers, so the parsers can't be folded at compile time
+const char *volatile DATE = "Sun, 28 Mar 2021 01:59:59 GMT";
+const char *volatile TZ_OFFSET = "+05:30";
+const char *volatile NETWORK_HINTS = "-67,11,a0b1c2d3e4f5";
+const char *volatile SCHEDULE_LINE = "62,7,0,0,alarm";
+
+void test_parsers() {
+  bench("parseRFC7231Date", [](uint64_t) {
+    keep(parseRFC7231Date(DATE));
+  });
+  bench("parseTzOffset", [](uint64_t) {
+    int32_t offset;
+    keep(parseTzOffset(TZ_OFFSET, offset));
+    keep(offset);
+  });
+  bench("parseNetworkHints", [](uint64_t) {
+    int8_t rssi;
+    uint8_t channel, bssid[6];
+    keep(parseNetworkHints(NETWORK_HINTS, rssi, channel, bssid));
+    keep(bssid);
+  });
+  bench("Scheduler::parse", [](uint64_t) {
+    Scheduler::Rule rule;
+    keep(Scheduler::parse(SCHEDULE_LINE, rule));
+    keep(rule);
+  });
+}
+
+void test_routes() {
+  benchRoutes<4>();
+  benchRoutes<8>();
+  benchRoutes<16>();
+  benchRoutes<32>();
+}
+
+void test_loop() {
+  static Scheduler scheduler;
+  for (uint8_t i = 0; i < Scheduler::MAX_RULES; ++i) {
+    Scheduler::Rule rule = {uint8_t(1 + i * 37 % 127), uint8_t(i % 3 ? i % 24 : Scheduler::EVERY_HOUR),
+                            uint8_t(i * 7 % 60), Scheduler::ACTION_CATHODE_CLEANING, ""};
+    scheduler.add(rule);
+  }
+  const time_t start = daysFromCivil(2021, 6, 1) * SECS_PER_DAY;
+  // a loop every 50 ms, most find nothing due
+  bench("Scheduler::due/32", [&](uint64_t i) {
+    time_t localTime = start + i / 20;
+    for (int8_t rule; (rule = scheduler.due(localTime)) >= 0;) {
+      keep(rule);
+    }
+  });
+
+  static MessageStats stats;
+  static MessageQueue queue(stats);
+  bench("MessageQueue::push+doLoop", [](uint64_t i) {
+    uint32_t now = i * 50;
+    if (i % 20 == 0) {
+      keep(queue.push(i % 10000, i * 37 % 256, 60000, 3000, now));
+    }
+    keep(queue.doLoop(now));
+  });
+
+  static TimerClock timer(TimerClock::STOPWATCH, 0, 0);
+  bench("TimerClock::faceAt", [](uint64_t i) {
+    keep(timer.faceAt(i * 10000));
+  });
+
+  static SolarBrightness brightness;
+  const Location london = {51.5074, -0.1278};
+  bench("SolarBrightness::dutyAt", [&](uint64_t i) {
+    keep(brightness.dutyAt(start + i / 20, london, 0));
+  });
+}
+
+void test_network_selection() {
+  static KnownNetworks known;
+  for (uint8_t i = 0; i < 8; ++i) {
+    known.networks[i] = {"known-" + std::to_string(i), 0};
+  }
+  known.networks[7].ssid = "home";
+  static CrowdedScan<30> scan;
+  bench("selectKnownNetwork/8x30", [](uint64_t) {
+    int8_t scanIndex;
+    keep(selectKnownNetwork(known, scan, 30, scanIndex));
+    keep(scanIndex);
+  });
+}
+
+const char *volatile CONFIG = "home\r\nsecret-psk\r\n0123456789abcdef0123456789abcdef\r\nauto\r\n"
+                              "http://192.168.1.2/manifest.json\r\n";
+const char *volatile API_KEY = "0123456789abcdef0123456789abcdef";
+
+void test_settings() {
+  bench("readSettingsValue/config", [](uint64_t) {
+    MemoryFile file = {CONFIG, 0};
+    std::string values[CONFIG_KEYS_COUNT];
+    for (std::string &value : values) {
+      value = readSettingsValue<std::string>(file);
+    }
+    keep(values);
+  });
+
+  static std::string values[CONFIG_KEYS_COUNT];
+  MemoryFile file = {CONFIG, 0};
+  for (std::string &value : values) {
+    value = readSettingsValue<std::string>(file);
+  }
+  // as sendSettings() does
+  bench("settingsToJson+serializeJson", [](uint64_t) {
+    StaticJsonDocument<512> jsonDoc;
+    settingsToJson(jsonDoc, values, CONFIG_KEYS_COUNT, false);
+    std::string jsonStr;
+    serializeJson(jsonDoc, jsonStr);
+    keep(jsonStr);
+  });
+
+  // both requests of getTime()
+  const Location berlin = {52.5200, 13.4050};
+  bench("timezoneUrl+appendTimezoneQuery", [&](uint64_t i) {
+    std::string url;
+    timezoneUrl(url, API_KEY);
+    keep(url);
+    appendTimezoneQuery(url, berlin, 1616893199 + i);
+    keep(url);
+  });
+}
+
+void test_display() {
+  const time_t start = daysFromCivil(2021, 6, 1) * SECS_PER_DAY;
+  bench("timeDigits", [&](uint64_t i) {
+    uint8_t digits[TUBES_COUNT];
+    keep(timeDigits(start + i, digits));
+    keep(digits);
+  });
+
+  // as Display::showTime() does, a loop every 50 ms, a new frame every second
+  static Frame frame = {};
+  bench("showTime frame", [&](uint64_t i) {
+    uint8_t digits[TUBES_COUNT];
+    bool dot = timeDigits(start + i / 20, digits);
+    if (!frame.shows(digits, dot, 255)) {
+      frame.set(digits, dot, 255);
+      keep(frame.hash());
+    }
+  });
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parsers);
+  RUN_TEST(test_routes);
+  RUN_TEST(test_network_selection);
+  RUN_TEST(test_settings);
+  RUN_TEST(test_display);
+  RUN_TEST(test_loop);
+  return UNITY_END();
+}
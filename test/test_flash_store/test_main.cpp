@@ -0,0 +1,174 @@
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <unity.h>
+
+#include "FlashStore.h"
+
+// files in RAM, counting what hits the flash
+struct FakeFs {
+  std::map<std::string, std::string> files;
+  uint32_t writes = 0;
+  uint32_t now = 0;
+};
+
+struct FakeFile {
+  std::string *content;
+
+  explicit operator bool() const {
+    return content;
+  }
+
+  std::string readString() const {
+    return *content;
+  }
+
+  size_t print(const std::string &data) {
+    content->append(data);
+    return data.length();
+  }
+
+  void close() {}
+};
+
+struct FakeStorage {
+  typedef FakeFile File;
+  typedef std::string Content;
+
+  FakeFs &fs;
+
+  File open(const char *path, const char *mode) {
+    if (*mode == 'w') {
+      ++fs.writes;
+      std::string &content = fs.files[path];
+      content.clear();
+      return {&content};
+    }
+    auto file = fs.files.find(path);
+    return {file != fs.files.end() ? &file->second : nullptr};
+  }
+
+  size_t blockSize() const {
+    return 4096;
+  }
+
+  uint32_t millis() const {
+    return fs.now;
+  }
+};
+
+const char CONFIG_FILE[] = "/config.cfg";
+const char NETWORKS_FILE[] = "/networks.cfg";
+const char SCHEDULE_FILE[] = "/schedule.cfg";
+const uint32_t LOOP_MILLIS = 50;
+
+// doLoop() for a while, as the main loop does
+void runFor(FlashStore<FakeStorage> &store, FakeFs &fs, uint32_t millis) {
+  for (uint32_t until = fs.now + millis; fs.now < until; fs.now += LOOP_MILLIS) {
+    store.doLoop();
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_identical_content_skipped() {
+  FakeFs fs;
+  fs.files[CONFIG_FILE] = "home\n";
+  FlashStore<FakeStorage> store({fs});
+  store.begin();
+  TEST_ASSERT_TRUE(store.write(CONFIG_FILE, "home\n"));
+  TEST_ASSERT_EQUAL_UINT32(0, fs.writes);
+  TEST_ASSERT_TRUE(store.write(CONFIG_FILE, "work\n"));
+  TEST_ASSERT_EQUAL_UINT32(1, fs.writes);
+  TEST_ASSERT_EQUAL_UINT32(1, store.stats(0).suppressed);
+  TEST_ASSERT_EQUAL_UINT32(2, store.stats(0).erases);
+}
+
+void test_burst_coalesced() {
+  FakeFs fs;
+  FlashStore<FakeStorage> store({fs});
+  store.begin();
+  for (char c = 'a'; c <= 'e'; ++c) {
+    store.write(NETWORKS_FILE, std::string(1, c), true);
+    runFor(store, fs, 200);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, fs.writes);
+  runFor(store, fs, FlashStore<FakeStorage>::COALESCE_MILLIS);
+  TEST_ASSERT_EQUAL_UINT32(1, fs.writes);
+  TEST_ASSERT_EQUAL_STRING("e", fs.files[NETWORKS_FILE].c_str());
+}
+
+void test_open_writes_pending() {
+  FakeFs fs;
+  FlashStore<FakeStorage> store({fs});
+  store.begin();
+  store.write(NETWORKS_FILE, "a", true);
+  FakeFile file = store.open(NETWORKS_FILE);
+  TEST_ASSERT_EQUAL_STRING("a", file.readString().c_str());
+  // and not once more later
+  runFor(store, fs, FlashStore<FakeStorage>::COALESCE_MILLIS);
+  TEST_ASSERT_EQUAL_UINT32(1, fs.writes);
+}
+
+/*
+ * A year of settings traffic in virtual time. Every day the clock boots and
+ * refreshes network hints in a coalesced burst, which change only weekly,
+ * and the settings page is saved unchanged, except for a monthly tz change.
+ * Once a month four schedule rules are edited one by one.
+ */
+const uint16_t DAYS = 365;
+const uint32_t DAY_MILLIS = 24 * 3600000UL;
+const uint8_t BURST_WRITES = 5;
+const uint8_t RULE_EDITS = 4;
+
+void test_year() {
+  FakeFs fs;
+  FlashStore<FakeStorage> store({fs});
+  store.begin();
+  uint32_t calls = 0;
+  for (uint16_t day = 0; day < DAYS; ++day) {
+    fs.now = day * DAY_MILLIS;
+    uint16_t week = day / 7 * 7;
+    for (uint8_t i = 0; i < BURST_WRITES; ++i) {
+      uint8_t step = week == day ? i : BURST_WRITES - 1;
+      store.write(NETWORKS_FILE, "home\n" + std::to_string(week) + "," + std::to_string(step) + "\n", true);
+      ++calls;
+      runFor(store, fs, 200);
+    }
+    runFor(store, fs, FlashStore<FakeStorage>::COALESCE_MILLIS);
+
+    store.write(CONFIG_FILE, "home\n" + std::to_string(day / 30) + "\n");
+    ++calls;
+    if (day % 30 == 15) {
+      for (uint8_t rule = 1; rule <= RULE_EDITS; ++rule) {
+        store.write(SCHEDULE_FILE, std::to_string(day) + ":" + std::to_string(rule) + "\n");
+        ++calls;
+      }
+    }
+  }
+
+  uint32_t writes, bytesWritten;
+  store.totals(writes, bytesWritten);
+  uint32_t erases = 0;
+  for (uint8_t i = 0; i < store.size(); ++i) {
+    erases += store.stats(i).erases;
+  }
+  printf("{\"days\": %u, \"write-calls\": %u, \"flash-writes\": %u, \"flash-bytes-written\": %u, \"erases\": %u}\n",
+    DAYS, calls, writes, bytesWritten, erases);
+  TEST_ASSERT_EQUAL_UINT32(fs.writes, writes);
+  // weekly hints, monthly settings and the rule edits
+  TEST_ASSERT_EQUAL_UINT32(53 + 13 + 12 * RULE_EDITS, writes);
+  TEST_ASSERT_EQUAL_STRING("home\n364,4\n", fs.files[NETWORKS_FILE].c_str());
+  TEST_ASSERT_EQUAL_STRING("home\n12\n", fs.files[CONFIG_FILE].c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_identical_content_skipped);
+  RUN_TEST(test_burst_coalesced);
+  RUN_TEST(test_open_writes_pending);
+  RUN_TEST(test_year);
+  return UNITY_END();
+}
@@ -0,0 +1,155 @@
+#include <new>
+#include <stdlib.h>
+#include <unity.h>
+
+#include "MessageQueue.h"
+
+// counts allocations, the queue mustn't make any
+size_t allocations = 0;
+
+void *operator new(size_t size) {
+  ++allocations;
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+const uint32_t TTL = 60000;
+const uint32_t SHOW = 3000;
+
+// loop() every 10 ms from and until the given times, returns what's shown last
+int16_t runUntil(MessageQueue &queue, uint32_t from, uint32_t until) {
+  int16_t shown = -1;
+  for (uint32_t now = from; now <= until; now += 10) {
+    shown = queue.doLoop(now);
+  }
+  return shown;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_shows_by_priority_then_age() {
+  MessageStats stats = {};
+  MessageQueue queue(stats);
+  queue.push(1, 0, TTL, SHOW, 0);
+  queue.push(2, 5, TTL, SHOW, 0);
+  queue.push(3, 5, TTL, SHOW, 0);
+  queue.push(4, 9, TTL, SHOW, 0);
+  const int16_t expected[] = {4, 2, 3, 1};
+  uint32_t now = 0;
+  for (int16_t value : expected) {
+    TEST_ASSERT_EQUAL(value, queue.doLoop(now));
+    // shown for its duration, then the time for a gap
+    TEST_ASSERT_EQUAL(value, queue.doLoop(now + SHOW - 1));
+    TEST_ASSERT_EQUAL(-1, queue.doLoop(now + SHOW));
+    TEST_ASSERT_EQUAL(-1, queue.doLoop(now + SHOW + MessageQueue::GAP_MILLIS - 1));
+    now += SHOW + MessageQueue::GAP_MILLIS;
+  }
+  TEST_ASSERT_EQUAL(-1, queue.doLoop(now));
+  TEST_ASSERT_EQUAL(4, stats.shown);
+}
+
+void test_full_queue_drops_lowest_priority() {
+  MessageStats stats = {};
+  MessageQueue queue(stats);
+  for (uint8_t i = 0; i < MessageQueue::CAPACITY; ++i) {
+    // long enough to wait for all the others
+    TEST_ASSERT_TRUE(queue.push(100 + i, 10 + i, 10 * TTL, SHOW, 0));
+  }
+  // lower than all of them, or as low as the lowest but newer
+  TEST_ASSERT_FALSE(queue.push(1, 5, TTL, SHOW, 0));
+  TEST_ASSERT_FALSE(queue.push(2, 10, TTL, SHOW, 0));
+  TEST_ASSERT_TRUE(queue.push(3, 50, TTL, SHOW, 0));
+  TEST_ASSERT_EQUAL(3, stats.dropped);
+
+  uint32_t now = 0;
+  TEST_ASSERT_EQUAL(3, queue.doLoop(now));
+  for (uint8_t i = MessageQueue::CAPACITY - 1; i > 0; --i) {
+    TEST_ASSERT_EQUAL(100 + i, runUntil(queue, now + 10, now + SHOW + MessageQueue::GAP_MILLIS));
+    now += SHOW + MessageQueue::GAP_MILLIS;
+  }
+  // the first one was dropped for the last
+  TEST_ASSERT_EQUAL(-1, runUntil(queue, now + 10, now + SHOW + MessageQueue::GAP_MILLIS));
+}
+
+void test_expired_messages_are_skipped() {
+  MessageStats stats = {};
+  MessageQueue queue(stats);
+  queue.push(1, 9, TTL, SHOW, 0);
+  queue.push(2, 5, 4000, SHOW, 0);
+  queue.push(3, 1, TTL, SHOW, 0);
+  TEST_ASSERT_EQUAL(1, queue.doLoop(0));
+  // 2 waited for 1 and the gap, past its TTL
+  TEST_ASSERT_EQUAL(3, runUntil(queue, 10, SHOW + MessageQueue::GAP_MILLIS));
+  TEST_ASSERT_EQUAL(2, stats.shown);
+  TEST_ASSERT_EQUAL(1, stats.expired);
+  TEST_ASSERT_EQUAL(SHOW + MessageQueue::GAP_MILLIS, stats.maxLatencyMillis);
+}
+
+/*
+ * An hour of random producers with loop() every 10 ms: a top priority
+ * message never waits longer than the longest message, a gap and a loop,
+ * and nothing is allocated on the way.
+ */
+void test_latency_is_bounded() {
+  const uint32_t LOOP_MILLIS = 10;
+  const uint8_t TOP = 255;
+  MessageStats stats = {};
+  MessageQueue queue(stats);
+  uint32_t enqueuedAt[MessageQueue::MAX_VALUE + 1] = {};
+  uint8_t priorities[MessageQueue::MAX_VALUE + 1] = {};
+  uint32_t random = 3;
+  uint16_t nextValue = 1;
+  int16_t shown = -1;
+  uint32_t maxTopLatency = 0;
+  uint16_t topShown = 0;
+  bool topPending = false;
+  allocations = 0;
+  for (uint32_t now = 0; now < 3600 * 1000; now += LOOP_MILLIS) {
+    random = random * 1103515245 + 12345;
+    // a message every half a second on average, a top one at a time
+    if ((random >> 8) % 50 == 0 && nextValue <= MessageQueue::MAX_VALUE) {
+      uint8_t priority = (random >> 16) % 8 == 0 && !topPending ? TOP : (random >> 16) % 200;
+      uint32_t showMillis = 1000 + (random >> 4) % (MessageQueue::MAX_SHOW_MILLIS - 999);
+      if (queue.push(nextValue, priority, TTL, showMillis, now)) {
+        enqueuedAt[nextValue] = now;
+        priorities[nextValue] = priority;
+        topPending |= priority == TOP;
+      }
+      ++nextValue;
+    }
+    int16_t value = queue.doLoop(now);
+    if (value != shown && value >= 0 && priorities[value] == TOP) {
+      uint32_t latency = now - enqueuedAt[value];
+      maxTopLatency = latency > maxTopLatency ? latency : maxTopLatency;
+      ++topShown;
+      topPending = false;
+    }
+    shown = value;
+  }
+  TEST_ASSERT_EQUAL(0, allocations);
+  TEST_ASSERT_GREATER_OR_EQUAL(100, topShown);
+  TEST_ASSERT_LESS_OR_EQUAL(MessageQueue::MAX_SHOW_MILLIS + MessageQueue::GAP_MILLIS + LOOP_MILLIS, maxTopLatency);
+  TEST_ASSERT_GREATER_THAN(0, stats.expired + stats.dropped);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_shows_by_priority_then_age);
+  RUN_TEST(test_full_queue_drops_lowest_priority);
+  RUN_TEST(test_expired_messages_are_skipped);
+  RUN_TEST(test_latency_is_bounded);
+  return UNITY_END();
+}
@@ -0,0 +1,88 @@
+#include <string>
+#include <unity.h>
+
+#include "NetworkSelect.h"
+
+// known networks as KnownNetworks has them
+struct Known {
+  struct Network {
+    std::string ssid;
+    uint8_t priority;
+  };
+
+  const Network *networks;
+  uint8_t count;
+
+  int8_t indexOf(const std::string &ssid) const {
+    for (uint8_t i = 0; i < count; ++i) {
+      if (networks[i].ssid == ssid) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  const Network &operator[](uint8_t i) const {
+    return networks[i];
+  }
+};
+
+// scan results as WiFi has them
+struct Scan {
+  struct Network {
+    std::string ssid;
+    int32_t rssi;
+  };
+
+  const Network *networks;
+
+  const std::string &SSID(int8_t i) {
+    return networks[i].ssid;
+  }
+
+  int32_t RSSI(int8_t i) {
+    return networks[i].rssi;
+  }
+};
+
+const Known::Network KNOWN[] = {{"home", 0}, {"office", 0}, {"phone", 1}};
+const Known known = {KNOWN, 3};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_none_known() {
+  const Scan::Network found[] = {{"cafe", -40}, {"neighbor", -60}};
+  Scan scan = {found};
+  int8_t scanIndex;
+  TEST_ASSERT_EQUAL_INT8(-1, selectKnownNetwork(known, scan, 2, scanIndex));
+  TEST_ASSERT_EQUAL_INT8(-1, selectKnownNetwork(known, scan, 0, scanIndex));
+}
+
+void test_stronger_among_equal_priorities() {
+  const Scan::Network found[] = {{"home", -80}, {"cafe", -40}, {"office", -60}, {"home", -55}};
+  Scan scan = {found};
+  int8_t scanIndex;
+  // the other AP of "home" is stronger still
+  TEST_ASSERT_EQUAL_INT8(0, selectKnownNetwork(known, scan, 4, scanIndex));
+  TEST_ASSERT_EQUAL_INT8(3, scanIndex);
+  TEST_ASSERT_EQUAL_INT8(1, selectKnownNetwork(known, scan, 3, scanIndex));
+  TEST_ASSERT_EQUAL_INT8(2, scanIndex);
+}
+
+void test_priority_over_signal() {
+  const Scan::Network found[] = {{"home", -40}, {"phone", -85}};
+  Scan scan = {found};
+  int8_t scanIndex;
+  TEST_ASSERT_EQUAL_INT8(2, selectKnownNetwork(known, scan, 2, scanIndex));
+  TEST_ASSERT_EQUAL_INT8(1, scanIndex);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_none_known);
+  RUN_TEST(test_stronger_among_equal_priorities);
+  RUN_TEST(test_priority_over_signal);
+  return UNITY_END();
+}
@@ -0,0 +1,134 @@
+#include <unity.h>
+
+#include "Parsers.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_parses_dates() {
+  TEST_ASSERT_EQUAL(784887151, parseRFC7231Date("Tue, 15 Nov 1994 08:12:31 GMT"));
+  TEST_ASSERT_EQUAL(0, parseRFC7231Date("Thu, 01 Jan 1970 00:00:00 GMT"));
+  TEST_ASSERT_EQUAL(951782400, parseRFC7231Date("Tue, 29 Feb 2000 00:00:00 GMT"));
+  TEST_ASSERT_EQUAL(1609459199, parseRFC7231Date("Thu, 31 Dec 2020 23:59:59 GMT"));
+  TEST_ASSERT_EQUAL(1483228800, parseRFC7231Date("Sat, 31 Dec 2016 23:59:60 GMT"));
+}
+
+void test_rejects_malformed_dates() {
+  for (const char *date : {
+    "",
+    "Tue, 15 Nov 1994 08:12:31",
+    "Tue, 15 Nov 1994 08:12:31 GMT ",
+    "Tue, 15 Nov 1994 08:12:31 UTC",
+    "Tue 15 Nov 1994 08:12:31 GMT.",
+    "Tue, 15-Nov-1994 08:12:31 GMT",
+    "Tue, 15 Nov 1994 08-12-31 GMT",
+    "Tuesday, 15-Nov-94 08:12:31 GMT",
+    "Tue Nov 15 08:12:31 1994",
+    "Tue, 1a Nov 1994 08:12:31 GMT",
+    "Tue, 15 Nox 1994 08:12:31 GMT",
+    "Tue, 15 nov 1994 08:12:31 GMT",
+    "Tue, 00 Nov 1994 08:12:31 GMT",
+    "Tue, 31 Nov 1994 08:12:31 GMT",
+    "Tue, 29 Feb 1900 08:12:31 GMT",
+    "Tue, 99 Nov 1994 08:12:31 GMT",
+    "Tue, 15 Nov 1994 24:12:31 GMT",
+    "Tue, 15 Nov 1994 08:60:31 GMT",
+    "Tue, 15 Nov 1994 08:12:61 GMT",
+    "Tue, 15 Nov 1969 08:12:31 GMT",
+    "Tue, 15 Nov 2038 08:12:31 GMT",
+    "Tue, 15 Nov 9999 99:99:99 GMT",
+  }) {
+    TEST_ASSERT_EQUAL_MESSAGE(0, parseRFC7231Date(date), date);
+  }
+}
+
+void test_parses_tz_offsets() {
+  int32_t offset = 1;
+  TEST_ASSERT_TRUE(parseTzOffset("+00:00", offset));
+  TEST_ASSERT_EQUAL(0, offset);
+  TEST_ASSERT_TRUE(parseTzOffset("+05:45", offset));
+  TEST_ASSERT_EQUAL(20700, offset);
+  TEST_ASSERT_TRUE(parseTzOffset("-09:30", offset));
+  TEST_ASSERT_EQUAL(-34200, offset);
+  TEST_ASSERT_TRUE(parseTzOffset("+14:00", offset));
+  TEST_ASSERT_EQUAL(50400, offset);
+}
+
+void test_rejects_malformed_tz_offsets() {
+  for (const char *tz : {"", "auto", "05:45", "+5:45", "+05:4", "+0545", "+05:45 ", "*05:45", "+15:00", "+05:60", "+0a:00"}) {
+    int32_t offset = 1;
+    TEST_ASSERT_FALSE_MESSAGE(parseTzOffset(tz, offset), tz);
+    TEST_ASSERT_EQUAL_MESSAGE(1, offset, tz);
+  }
+}
+
+void test_parses_unsigned_numbers() {
+  uint32_t value = 1;
+  TEST_ASSERT_TRUE(parseUnsigned("0", 255, value));
+  TEST_ASSERT_EQUAL(0, value);
+  TEST_ASSERT_TRUE(parseUnsigned("255", 255, value));
+  TEST_ASSERT_EQUAL(255, value);
+  TEST_ASSERT_TRUE(parseUnsigned("007", 255, value));
+  TEST_ASSERT_EQUAL(7, value);
+  for (const char *str : {"", "256", "-1", "+1", " 1", "1 ", "1a", "abc", "1.5", "99999999999"}) {
+    value = 1;
+    TEST_ASSERT_FALSE_MESSAGE(parseUnsigned(str, 255, value), str);
+    TEST_ASSERT_EQUAL_MESSAGE(1, value, str);
+  }
+}
+
+void test_parses_network_hints() {
+  int8_t rssi;
+  uint8_t channel;
+  uint8_t bssid[6];
+  TEST_ASSERT_TRUE(parseNetworkHints("-67,11,a0B1c2D3e4F5", rssi, channel, bssid));
+  TEST_ASSERT_EQUAL(-67, rssi);
+  TEST_ASSERT_EQUAL(11, channel);
+  const uint8_t expected[] = {0xa0, 0xb1, 0xc2, 0xd3, 0xe4, 0xf5};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, bssid, 6);
+
+  // as saved for a network which was never seen
+  TEST_ASSERT_TRUE(parseNetworkHints("0,0,000000000000", rssi, channel, bssid));
+  TEST_ASSERT_EQUAL(0, rssi);
+  TEST_ASSERT_EQUAL(0, channel);
+}
+
+void test_zeroes_malformed_network_hints() {
+  for (const char *hints : {
+    "",
+    "-67",
+    "-67,11",
+    "-67,11,",
+    "-67,11,a0b1c2d3e4",
+    "-67,11,a0b1c2d3e4f5a6",
+    "-67,11,a0b1c2d3e4fg",
+    "-67,11,a0:b1:c2:d3:e4",
+    "-200,11,a0b1c2d3e4f5",
+    "10,11,a0b1c2d3e4f5",
+    "-67,15,a0b1c2d3e4f5",
+    "-67,-1,a0b1c2d3e4f5",
+    "x,11,a0b1c2d3e4f5",
+  }) {
+    int8_t rssi = -1;
+    uint8_t channel = 1;
+    uint8_t bssid[6] = {1, 1, 1, 1, 1, 1};
+    const uint8_t zeroes[6] = {};
+    TEST_ASSERT_FALSE_MESSAGE(parseNetworkHints(hints, rssi, channel, bssid), hints);
+    TEST_ASSERT_EQUAL_MESSAGE(0, rssi, hints);
+    TEST_ASSERT_EQUAL_MESSAGE(0, channel, hints);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(zeroes, bssid, 6, hints);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parses_dates);
+  RUN_TEST(test_rejects_malformed_dates);
+  RUN_TEST(test_parses_tz_offsets);
+  RUN_TEST(test_rejects_malformed_tz_offsets);
+  RUN_TEST(test_parses_unsigned_numbers);
+  RUN_TEST(test_parses_network_hints);
+  RUN_TEST(test_zeroes_malformed_network_hints);
+  return UNITY_END();
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <unity.h>
+
+#include "RadioPower.h"
+
+// virtual time and the mode last set
+struct SimRadio {
+  uint32_t &now;
+  RadioSleep &sleep;
+  uint32_t &switches;
+
+  uint32_t millis() const {
+    return now;
+  }
+
+  void setSleep(RadioSleep sleep) {
+    this->sleep = sleep;
+    ++switches;
+  }
+};
+
+uint32_t now;
+RadioSleep sleep;
+uint32_t switches;
+
+void setUp() {
+  now = 1000;
+  sleep = RADIO_MODEM_SLEEP;
+  switches = 0;
+}
+
+void tearDown() {}
+
+void test_sleep_by_users() {
+  RadioStats stats = {};
+  RadioPower<SimRadio> radio({now, sleep, switches}, stats);
+  TEST_ASSERT_EQUAL(RADIO_AWAKE, sleep);
+  radio.setNeeded(RADIO_MANAGEMENT, true, false);
+  TEST_ASSERT_EQUAL(RADIO_MODEM_SLEEP, sleep);
+  radio.setNeeded(RADIO_SYNC, true);
+  TEST_ASSERT_EQUAL(RADIO_AWAKE, sleep);
+  radio.setNeeded(RADIO_MANAGEMENT, true, true);
+  radio.setNeeded(RADIO_SYNC, false);
+  TEST_ASSERT_EQUAL(RADIO_AWAKE, sleep);
+  radio.setNeeded(RADIO_MANAGEMENT, true, false);
+  TEST_ASSERT_EQUAL(RADIO_MODEM_SLEEP, sleep);
+  // the radio is only told about actual changes
+  radio.setNeeded(RADIO_MANAGEMENT, true, false);
+  TEST_ASSERT_EQUAL_UINT32(4, switches);
+}
+
+void test_counts_time() {
+  RadioStats stats = {};
+  RadioPower<SimRadio> radio({now, sleep, switches}, stats);
+  radio.setNeeded(RADIO_MANAGEMENT, true, false);
+  now += 10000;
+  radio.setNeeded(RADIO_UPDATE, true);
+  now += 2000;
+  radio.setNeeded(RADIO_UPDATE, false);
+  now += 500;
+  radio.sample();
+  TEST_ASSERT_EQUAL_UINT32(10500, stats.sleepMillis[RADIO_MODEM_SLEEP]);
+  TEST_ASSERT_EQUAL_UINT32(2000, stats.sleepMillis[RADIO_AWAKE]);
+  TEST_ASSERT_EQUAL_UINT32(12500, stats.userMillis[RADIO_MANAGEMENT]);
+  TEST_ASSERT_EQUAL_UINT32(2000, stats.userMillis[RADIO_UPDATE]);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.userMillis[RADIO_SYNC]);
+  TEST_ASSERT_EQUAL_UINT32(12500, stats.totalMillis());
+}
+
+/*
+ * A day of the clock in virtual time, driving RadioPower the way
+ * ClocksBehavior::doLoop() does, a loop every 50 ms. The management server
+ * listens all day, a browser keeps a connection alive for a few seconds
+ * every half an hour, the clock syncs hourly and pulls an update at night.
+ * The energy drawn is compared with a radio kept awake all day.
+ */
+const uint32_t LOOP_MILLIS = 50;
+const uint32_t DAY_MILLIS = 24 * 3600000UL;
+const uint32_t SYNC_PERIOD_MILLIS = 3600000;
+const uint32_t SYNC_MILLIS = 3000;
+const uint32_t CLIENT_PERIOD_MILLIS = 1800000;
+const uint32_t CLIENT_MILLIS = 5000;
+const uint32_t UPDATE_AT_MILLIS = 3 * 3600000UL;
+const uint32_t UPDATE_MILLIS = 60000;
+
+void test_day_energy() {
+  RadioStats stats = {};
+  now = 0;
+  RadioPower<SimRadio> radio({now, sleep, switches}, stats);
+  for (now = 0; now < DAY_MILLIS; now += LOOP_MILLIS) {
+    radio.setNeeded(RADIO_SYNC, now % SYNC_PERIOD_MILLIS < SYNC_MILLIS);
+    radio.sample();
+    bool serving = (now + CLIENT_PERIOD_MILLIS / 2) % CLIENT_PERIOD_MILLIS < CLIENT_MILLIS;
+    radio.setNeeded(RADIO_MANAGEMENT, true, serving);
+    radio.setNeeded(RADIO_UPDATE, now - UPDATE_AT_MILLIS < UPDATE_MILLIS);
+  }
+  radio.sample();
+  TEST_ASSERT_EQUAL_UINT32(DAY_MILLIS, stats.totalMillis());
+  uint32_t awakeMillis = 24 * (SYNC_MILLIS + 2 * CLIENT_MILLIS) + UPDATE_MILLIS;
+  TEST_ASSERT_UINT_WITHIN(24 * 3 * LOOP_MILLIS, awakeMillis, stats.sleepMillis[RADIO_AWAKE]);
+
+  float energy = stats.energyEstimate();
+  float alwaysAwake = float(DAY_MILLIS) * RadioStats::CURRENT[RADIO_AWAKE] / 3600000;
+  float savings = 1 - energy / alwaysAwake;
+  printf("{\"radio-modem-sleep-secs\": %u, \"radio-awake-secs\": %u, \"energy-mah\": %.1f, "
+    "\"always-awake-mah\": %.1f, \"savings\": %.3f}\n", stats.sleepMillis[RADIO_MODEM_SLEEP] / 1000,
+    stats.sleepMillis[RADIO_AWAKE] / 1000, energy, alwaysAwake, savings);
+  TEST_ASSERT_TRUE(savings > 0.7);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_sleep_by_users);
+  RUN_TEST(test_counts_time);
+  RUN_TEST(test_day_energy);
+  return UNITY_END();
+}
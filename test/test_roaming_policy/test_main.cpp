@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string>
+#include <unity.h>
+
+#include "RoamingPolicy.h"
+
+const char SSID[] = "home";
+const uint8_t HALL[] = {0x02, 0, 0, 0, 0, 1};
+const uint8_t ATTIC[] = {0x02, 0, 0, 0, 0, 2};
+const uint32_t LOOP_MILLIS = 50;
+
+uint32_t nextRandom(uint32_t &random) {
+  random = random * 1103515245 + 12345;
+  return random >> 8;
+}
+
+// a reading off by up to 6 dB either way
+int8_t noisy(int8_t rssi, uint32_t &random) {
+  return rssi + int8_t(nextRandom(random) % 13) - 6;
+}
+
+// what WiFi reports after a scan
+struct Scan {
+  struct Network {
+    std::string ssid;
+    const uint8_t *bssid;
+    int8_t rssi;
+  };
+  Network networks[3];
+
+  const std::string &SSID(int8_t i) const {
+    return networks[i].ssid;
+  }
+
+  const uint8_t *BSSID(int8_t i) const {
+    return networks[i].bssid;
+  }
+
+  int8_t RSSI(int8_t i) const {
+    return networks[i].rssi;
+  }
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_select() {
+  RoamingPolicy policy;
+  policy.sample(-75, 0);
+  Scan scan = {{{SSID, HALL, -74}, {"neighbor", ATTIC, -40}, {SSID, ATTIC, -68}}};
+  // the same AP or another SSID don't count, -68 is within the margin
+  TEST_ASSERT_EQUAL_INT8(-1, policy.select(scan, 3, SSID, HALL));
+  scan.networks[2].rssi = -66;
+  TEST_ASSERT_EQUAL_INT8(2, policy.select(scan, 3, SSID, HALL));
+  TEST_ASSERT_EQUAL_INT8(-1, policy.select(scan, 2, SSID, HALL));
+}
+
+void test_spike_is_smoothed() {
+  RoamingPolicy policy;
+  uint32_t ms = 0;
+  for (; ms < RoamingPolicy::SCAN_MILLIS; ms += RoamingPolicy::SAMPLE_MILLIS) {
+    policy.sample(-65, ms);
+  }
+  policy.sample(-95, ms);
+  TEST_ASSERT_FALSE(policy.scanDue(ms));
+  for (uint8_t i = 0; i < 20; ++i) {
+    ms += RoamingPolicy::SAMPLE_MILLIS;
+    policy.sample(-80, ms);
+  }
+  TEST_ASSERT_TRUE(policy.scanDue(ms));
+  // and not again right away
+  TEST_ASSERT_FALSE(policy.scanDue(ms + RoamingPolicy::SAMPLE_MILLIS));
+}
+
+struct Walk {
+  uint32_t scans = 0;
+  uint32_t roams = 0;
+  uint32_t firstRoamMillis = 0;
+  const uint8_t *bssid = HALL;
+};
+
+/*
+ * An hour of noisy signal in virtual time, driving the policy the way
+ * RoamingMonitor::doLoop() does. The hall AP fades from hallFrom to hallTo
+ * dBm while the attic one stays at attic dBm.
+ */
+Walk walk(int8_t hallFrom, int8_t hallTo, int8_t attic) {
+  Walk result;
+  RoamingPolicy policy;
+  uint32_t random = 2021;
+  const uint32_t HOUR_MILLIS = 3600000;
+  for (uint32_t ms = 0; ms < HOUR_MILLIS; ms += LOOP_MILLIS) {
+    int8_t hall = hallFrom + int32_t(hallTo - hallFrom) * int32_t(ms / 1000) / int32_t(HOUR_MILLIS / 1000);
+    int8_t current = result.bssid == HALL ? hall : attic;
+    if (policy.isSampleDue(ms)) {
+      policy.sample(noisy(current, random), ms);
+    }
+    if (policy.scanDue(ms)) {
+      ++result.scans;
+      Scan scan = {{{SSID, HALL, noisy(hall, random)}, {SSID, ATTIC, noisy(attic, random)}}};
+      int8_t best = policy.select(scan, 2, SSID, result.bssid);
+      if (best >= 0) {
+        result.bssid = scan.networks[best].bssid;
+        policy.reset();
+        if (!result.roams++) {
+          result.firstRoamMillis = ms;
+        }
+      }
+    }
+  }
+  printf("{\"hall\": [%d, %d], \"attic\": %d, \"scans\": %u, \"roams\": %u, \"first-roam-secs\": %u}\n",
+    hallFrom, hallTo, attic, result.scans, result.roams, result.firstRoamMillis / 1000);
+  return result;
+}
+
+void test_roams_once_when_fading() {
+  Walk result = walk(-60, -90, -65);
+  TEST_ASSERT_EQUAL_UINT32(1, result.roams);
+  TEST_ASSERT_TRUE(result.bssid == ATTIC);
+  // not before the hall AP gets weak, at a third of the hour
+  TEST_ASSERT_GREATER_OR_EQUAL(1200000, result.firstRoamMillis);
+}
+
+void test_no_flapping_between_similar() {
+  Walk result = walk(-72, -74, -74);
+  TEST_ASSERT_GREATER_THAN(0, result.scans);
+  TEST_ASSERT_EQUAL_UINT32(0, result.roams);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_select);
+  RUN_TEST(test_spike_is_smoothed);
+  RUN_TEST(test_roams_once_when_fading);
+  RUN_TEST(test_no_flapping_between_similar);
+  return UNITY_END();
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <unity.h>
+
+// the firmware's tables, with every optional route
+#define NIXIECLOCK_HEAPDUMP
+#define NIXIECLOCK_TIMELINE
+#include "Routes.h"
+
+constexpr Route SINGLE_ROUTE[] = {{HTTP_GET, "/", false}};
+constexpr RouteTable<1> SINGLE_ROUTE_TABLE(SINGLE_ROUTE);
+static_assert(SINGLE_ROUTE_TABLE.isPerfect(), "SINGLE_ROUTE");
+
+constexpr Route DUPLICATE_ROUTES[] = {{HTTP_GET, "/settings", false}, {HTTP_POST, "/settings", false}, {HTTP_GET, "/settings", false}};
+constexpr RouteTable<3> DUPLICATE_ROUTE_TABLE(DUPLICATE_ROUTES);
+static_assert(!DUPLICATE_ROUTE_TABLE.isPerfect(), "DUPLICATE_ROUTES");
+
+template <size_t N>
+void assertFindsAll(const RouteTable<N> &table, const Route (&routes)[N]) {
+  TEST_ASSERT_TRUE(table.isPerfect());
+  for (size_t i = 0; i < N; ++i) {
+    TEST_ASSERT_EQUAL_INT(i, table.find(routes[i].method, routes[i].path));
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_firmware_tables_are_perfect() {
+  TEST_ASSERT_TRUE(CLOCKS_ROUTE_TABLE.isPerfect());
+  TEST_ASSERT_TRUE(CONFIG_ROUTE_TABLE.isPerfect());
+  TEST_ASSERT_EQUAL_INT(13, sizeof CLOCKS_ROUTES / sizeof *CLOCKS_ROUTES);
+  TEST_ASSERT_EQUAL_INT(10, sizeof CONFIG_ROUTES / sizeof *CONFIG_ROUTES);
+}
+
+void test_finds_every_route() {
+  assertFindsAll(CLOCKS_ROUTE_TABLE, CLOCKS_ROUTES);
+  assertFindsAll(CONFIG_ROUTE_TABLE, CONFIG_ROUTES);
+  assertFindsAll(SINGLE_ROUTE_TABLE, SINGLE_ROUTE);
+}
+
+void test_misses_unknown_routes() {
+  TEST_ASSERT_EQUAL_INT(-1, CLOCKS_ROUTE_TABLE.find(HTTP_PUT, "/settings"));
+  TEST_ASSERT_EQUAL_INT(-1, CLOCKS_ROUTE_TABLE.find(HTTP_GET, "/update"));
+  TEST_ASSERT_EQUAL_INT(-1, CLOCKS_ROUTE_TABLE.find(HTTP_GET, "/setting"));
+  TEST_ASSERT_EQUAL_INT(-1, CLOCKS_ROUTE_TABLE.find(HTTP_GET, "/settings/"));
+  TEST_ASSERT_EQUAL_INT(-1, CLOCKS_ROUTE_TABLE.find(HTTP_GET, "/"));
+  TEST_ASSERT_EQUAL_INT(-1, CLOCKS_ROUTE_TABLE.find(HTTP_GET, ""));
+  TEST_ASSERT_EQUAL_INT(-1, CONFIG_ROUTE_TABLE.find(HTTP_ANY, "/update"));
+  TEST_ASSERT_EQUAL_INT(-1, SINGLE_ROUTE_TABLE.find(HTTP_POST, "/"));
+}
+
+void test_keeps_secured_flags() {
+  TEST_ASSERT_TRUE(CLOCKS_ROUTE_TABLE[CLOCKS_ROUTE_TABLE.find(HTTP_POST, "/settings")].secured);
+  TEST_ASSERT_FALSE(CLOCKS_ROUTE_TABLE[CLOCKS_ROUTE_TABLE.find(HTTP_GET, "/settings")].secured);
+  TEST_ASSERT_TRUE(CLOCKS_ROUTE_TABLE[CLOCKS_ROUTE_TABLE.find(HTTP_GET, "/heap")].secured);
+  TEST_ASSERT_FALSE(CLOCKS_ROUTE_TABLE[CLOCKS_ROUTE_TABLE.find(HTTP_GET, "/metrics")].secured);
+}
+
+template <size_t N>
+void assertPlacesGenerated() {
+  static char paths[N][16];
+  Route routes[N];
+  for (size_t i = 0; i < N; ++i) {
+    snprintf(paths[i], sizeof *paths, "/route-%u", unsigned(i));
+    routes[i] = {uint8_t(HTTP_GET + i % 6), paths[i], false};
+  }
+  RouteTable<N> table(routes);
+  assertFindsAll(table, routes);
+}
+
+// the seed search used to give up on most sizes
+void test_places_tables_of_any_size() {
+  assertPlacesGenerated<2>();
+  assertPlacesGenerated<5>();
+  assertPlacesGenerated<8>();
+  assertPlacesGenerated<9>();
+  assertPlacesGenerated<16>();
+  assertPlacesGenerated<17>();
+  assertPlacesGenerated<32>();
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_firmware_tables_are_perfect);
+  RUN_TEST(test_finds_every_route);
+  RUN_TEST(test_misses_unknown_routes);
+  RUN_TEST(test_keeps_secured_flags);
+  RUN_TEST(test_places_tables_of_any_size);
+  return UNITY_END();
+}
@@ -0,0 +1,156 @@
+#include <unity.h>
+
+#include "Scheduler.h"
+
+const uint8_t EVERY_DAY = 0x7F;
+
+// local midnight of 2021-03-28, a Sunday, and of 2021-10-31 when DST starts and ends in the EU
+const time_t SPRING_FORWARD = daysFromCivil(2021, 3, 28) * SECS_PER_DAY;
+const time_t FALL_BACK = daysFromCivil(2021, 10, 31) * SECS_PER_DAY;
+
+Scheduler::Rule rule(uint8_t days, uint8_t hour, uint8_t minute) {
+  Scheduler::Rule rule = {days, hour, minute, Scheduler::ACTION_CATHODE_CLEANING, ""};
+  return rule;
+}
+
+// fires rules due at each local time, in order, returns how many fired
+uint16_t run(Scheduler &scheduler, const time_t *times, size_t count, time_t *fired, uint8_t *rules) {
+  uint16_t firedCount = 0;
+  for (size_t i = 0; i < count; ++i) {
+    for (int8_t rule; (rule = scheduler.due(times[i])) >= 0; ++firedCount) {
+      fired[firedCount] = times[i];
+      rules[firedCount] = rule;
+    }
+  }
+  return firedCount;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_parses_stored_rules() {
+  Scheduler::Rule parsed;
+  TEST_ASSERT_TRUE(Scheduler::parse("62,7,0,0,alarm", parsed));
+  TEST_ASSERT_EQUAL(62, parsed.days);
+  TEST_ASSERT_EQUAL(7, parsed.hour);
+  TEST_ASSERT_EQUAL(0, parsed.minute);
+  TEST_ASSERT_EQUAL(Scheduler::ACTION_ANIMATION, parsed.action);
+  TEST_ASSERT_EQUAL_STRING("alarm", parsed.name);
+  TEST_ASSERT_TRUE(Scheduler::parse("127,255,30,2,", parsed));
+  TEST_ASSERT_EQUAL(Scheduler::EVERY_HOUR, parsed.hour);
+
+  for (const char *line : {"", "62,7,0,0", "0,7,0,0,alarm", "128,7,0,0,alarm", "62,24,0,0,alarm",
+                           "62,7,60,0,alarm", "62,7,0,4,alarm", "62,7,0,0,", "62,7,0,0,Alarm",
+                           "62,7,0,0,a-name-of-17-chars", "318,7,0,0,alarm", "62,-1,0,0,alarm"}) {
+    TEST_ASSERT_FALSE_MESSAGE(Scheduler::parse(line, parsed), line);
+  }
+}
+
+// every occurrence over two weeks fires once and in order, whatever the rules
+void test_fires_every_occurrence_in_order() {
+  Scheduler scheduler;
+  uint32_t random = 7;
+  for (uint8_t i = 0; i < Scheduler::MAX_RULES; ++i) {
+    random = random * 1103515245 + 12345;
+    uint8_t days = (random >> 8) % 127 + 1;
+    uint8_t hour = (random >> 16) % 6 ? (random >> 16) % 24 : Scheduler::EVERY_HOUR;
+    TEST_ASSERT_TRUE(scheduler.add(rule(days, hour, (random >> 24) % 60)));
+  }
+  const time_t start = daysFromCivil(2021, 6, 1) * SECS_PER_DAY;
+  uint16_t expected = 0;
+  for (time_t minute = start + SECS_PER_MIN; minute <= start + 14 * SECS_PER_DAY; minute += SECS_PER_MIN) {
+    uint8_t weekDay = (minute / SECS_PER_DAY + 4) % 7;
+    uint8_t hour = minute % SECS_PER_DAY / SECS_PER_HOUR;
+    uint8_t fired[Scheduler::MAX_RULES] = {};
+    for (int8_t due; (due = scheduler.due(minute)) >= 0;) {
+      ++fired[due];
+    }
+    for (uint8_t i = 0; i < Scheduler::MAX_RULES; ++i) {
+      const Scheduler::Rule &rule = scheduler[i];
+      bool occurs = (rule.days & 1 << weekDay) && (rule.hour == Scheduler::EVERY_HOUR || rule.hour == hour)
+        && rule.minute == minute % SECS_PER_HOUR / SECS_PER_MIN;
+      TEST_ASSERT_EQUAL(occurs, fired[i]);
+      expected += occurs;
+    }
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(14 * 24, expected);
+}
+
+// 02:00 becomes 03:00: events in the skipped hour fire once at 03:00
+void test_spring_forward_fires_skipped_events_once() {
+  Scheduler scheduler;
+  scheduler.add(rule(EVERY_DAY, 2, 30));
+  scheduler.add(rule(EVERY_DAY, Scheduler::EVERY_HOUR, 15));
+  scheduler.add(rule(EVERY_DAY, 3, 0));
+  const time_t times[] = {
+    SPRING_FORWARD + 1 * SECS_PER_HOUR + 59 * SECS_PER_MIN,
+    SPRING_FORWARD + 3 * SECS_PER_HOUR,
+    SPRING_FORWARD + 3 * SECS_PER_HOUR + 1 * SECS_PER_MIN,
+    SPRING_FORWARD + 3 * SECS_PER_HOUR + 15 * SECS_PER_MIN,
+  };
+  time_t fired[8];
+  uint8_t rules[8];
+  TEST_ASSERT_EQUAL(4, run(scheduler, times, 4, fired, rules));
+  // the skipped 02:15 and 02:30 once, then 03:00 on time and 03:15
+  TEST_ASSERT_EQUAL(times[1], fired[0]);
+  TEST_ASSERT_EQUAL(1, rules[0]);
+  TEST_ASSERT_EQUAL(times[1], fired[1]);
+  TEST_ASSERT_EQUAL(0, rules[1]);
+  TEST_ASSERT_EQUAL(times[1], fired[2]);
+  TEST_ASSERT_EQUAL(2, rules[2]);
+  TEST_ASSERT_EQUAL(times[3], fired[3]);
+  TEST_ASSERT_EQUAL(1, rules[3]);
+}
+
+// 03:00 becomes 02:00 again: events in the repeated hour don't fire twice
+void test_fall_back_doesnt_repeat_events() {
+  Scheduler scheduler;
+  scheduler.add(rule(EVERY_DAY, 2, 30));
+  scheduler.add(rule(EVERY_DAY, Scheduler::EVERY_HOUR, 45));
+  time_t times[2 * 60 + 60 + 1];
+  size_t count = 0;
+  // 02:00-02:59 twice, then 03:00-03:59, a minute at a time
+  for (uint8_t pass = 0; pass < 2; ++pass) {
+    for (uint8_t minute = 0; minute < 60; ++minute) {
+      times[count++] = FALL_BACK + 2 * SECS_PER_HOUR + minute * SECS_PER_MIN;
+    }
+  }
+  for (uint8_t minute = 0; minute <= 60; ++minute) {
+    times[count++] = FALL_BACK + 3 * SECS_PER_HOUR + minute * SECS_PER_MIN;
+  }
+  time_t fired[8];
+  uint8_t rules[8];
+  TEST_ASSERT_EQUAL(3, run(scheduler, times, count, fired, rules));
+  TEST_ASSERT_EQUAL(FALL_BACK + 2 * SECS_PER_HOUR + 30 * SECS_PER_MIN, fired[0]);
+  TEST_ASSERT_EQUAL(0, rules[0]);
+  TEST_ASSERT_EQUAL(FALL_BACK + 2 * SECS_PER_HOUR + 45 * SECS_PER_MIN, fired[1]);
+  TEST_ASSERT_EQUAL(1, rules[1]);
+  TEST_ASSERT_EQUAL(FALL_BACK + 3 * SECS_PER_HOUR + 45 * SECS_PER_MIN, fired[2]);
+  TEST_ASSERT_EQUAL(1, rules[2]);
+}
+
+// the heap is rebuilt when rules change, without firing anything already fired
+void test_changing_rules_keeps_fired_events() {
+  Scheduler scheduler;
+  scheduler.add(rule(EVERY_DAY, 7, 0));
+  const time_t seven = FALL_BACK + 7 * SECS_PER_HOUR;
+  TEST_ASSERT_EQUAL(-1, scheduler.due(seven - 1));
+  TEST_ASSERT_EQUAL(0, scheduler.due(seven));
+  scheduler.add(rule(EVERY_DAY, 8, 0));
+  TEST_ASSERT_EQUAL(-1, scheduler.due(seven + 1));
+  TEST_ASSERT_TRUE(scheduler.remove(1));
+  TEST_ASSERT_FALSE(scheduler.remove(1));
+  TEST_ASSERT_EQUAL(-1, scheduler.due(seven + SECS_PER_DAY - 1));
+  TEST_ASSERT_EQUAL(0, scheduler.due(seven + SECS_PER_DAY));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parses_stored_rules);
+  RUN_TEST(test_fires_every_occurrence_in_order);
+  RUN_TEST(test_spring_forward_fires_skipped_events_once);
+  RUN_TEST(test_fall_back_doesnt_repeat_events);
+  RUN_TEST(test_changing_rules_keeps_fired_events);
+  return UNITY_END();
+}
@@ -0,0 +1,75 @@
+#include <string>
+#include <unity.h>
+
+#include "Settings.h"
+
+const std::string SAVED[CONFIG_KEYS_COUNT] = {"home", "secret", "0123456789abcdef", "auto", ""};
+
+// the saved settings with value i replaced
+void changed(std::string (&values)[CONFIG_KEYS_COUNT], uint8_t i, const char *value) {
+  for (uint8_t j = 0; j < CONFIG_KEYS_COUNT; ++j) {
+    values[j] = SAVED[j];
+  }
+  values[i] = value;
+}
+
+struct MemoryFile {
+  const char *data;
+
+  int read() {
+    return *data ? *data++ : -1;
+  }
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_diff() {
+  std::string values[CONFIG_KEYS_COUNT];
+  changed(values, CONFIG_SSID, "home");
+  TEST_ASSERT_EQUAL_HEX8(0, diffSettings(values, SAVED));
+  changed(values, CONFIG_TZ, "+0100");
+  TEST_ASSERT_EQUAL_HEX8(1 << CONFIG_TZ, diffSettings(values, SAVED));
+  values[CONFIG_SSID_PSK] = "";
+  TEST_ASSERT_EQUAL_HEX8(1 << CONFIG_TZ | 1 << CONFIG_SSID_PSK, diffSettings(SAVED, values));
+}
+
+void test_actions() {
+  TEST_ASSERT_EQUAL_HEX8(0, settingsActions(0, "auto"));
+  TEST_ASSERT_EQUAL_HEX8(SETTINGS_RECONNECT, settingsActions(1 << CONFIG_SSID, "auto"));
+  TEST_ASSERT_EQUAL_HEX8(SETTINGS_RECONNECT, settingsActions(1 << CONFIG_SSID | 1 << CONFIG_SSID_PSK, "auto"));
+  TEST_ASSERT_EQUAL_HEX8(SETTINGS_SYNC, settingsActions(1 << CONFIG_API_KEY, "auto"));
+  TEST_ASSERT_EQUAL_HEX8(SETTINGS_GEOLOCATE, settingsActions(1 << CONFIG_TZ, "auto"));
+  // a fixed offset doesn't need the network
+  TEST_ASSERT_EQUAL_HEX8(SETTINGS_TZ_OFFSET, settingsActions(1 << CONFIG_TZ, "+0100"));
+  TEST_ASSERT_EQUAL_HEX8(SETTINGS_UPDATER, settingsActions(1 << CONFIG_OTA_URL, "auto"));
+}
+
+void test_saving_unchanged_does_nothing() {
+  std::string values[CONFIG_KEYS_COUNT];
+  changed(values, CONFIG_OTA_URL, "");
+  TEST_ASSERT_EQUAL_HEX8(0, settingsActions(diffSettings(values, SAVED), values[CONFIG_TZ].c_str()));
+  changed(values, CONFIG_OTA_URL, "http://10.0.0.2/manifest.json");
+  values[CONFIG_TZ] = "-0500";
+  TEST_ASSERT_EQUAL_HEX8(SETTINGS_TZ_OFFSET | SETTINGS_UPDATER,
+    settingsActions(diffSettings(values, SAVED), values[CONFIG_TZ].c_str()));
+}
+
+void test_read_values() {
+  MemoryFile file = {"home\r\nwith\rcr\r\n\r\nlast"};
+  TEST_ASSERT_EQUAL_STRING("home", readSettingsValue<std::string>(file).c_str());
+  TEST_ASSERT_EQUAL_STRING("with\rcr", readSettingsValue<std::string>(file).c_str());
+  TEST_ASSERT_EQUAL_STRING("", readSettingsValue<std::string>(file).c_str());
+  TEST_ASSERT_EQUAL_STRING("last", readSettingsValue<std::string>(file).c_str());
+  TEST_ASSERT_EQUAL_STRING("", readSettingsValue<std::string>(file).c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_read_values);
+  RUN_TEST(test_diff);
+  RUN_TEST(test_actions);
+  RUN_TEST(test_saving_unchanged_does_nothing);
+  return UNITY_END();
+}
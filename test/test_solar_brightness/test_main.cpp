@@ -0,0 +1,111 @@
+#include <unity.h>
+
+#include "SolarBrightness.h"
+
+const Location LONDON = {51.5074, -0.1278};
+const Location NEW_YORK = {40.7128, -74.0060};
+const Location SYDNEY = {-33.8688, 151.2093};
+const Location TROMSO = {69.6492, 18.9553};
+
+// minutes since local midnight of the first day and first night duty of the day
+struct SunTimes {
+  int16_t sunrise = -1;
+  int16_t sunset = -1;
+  uint8_t minDuty = SolarBrightness::DAY_DUTY;
+  uint8_t maxDuty = SolarBrightness::NIGHT_DUTY;
+};
+
+SunTimes sunTimesOn(const Location &location, int32_t tzOffset, int32_t year, uint8_t month, uint8_t day) {
+  SolarBrightness brightness;
+  SunTimes times;
+  time_t midnight = daysFromCivil(year, month, day) * SECS_PER_DAY;
+  uint8_t previous = 0;
+  for (int16_t minute = 0; minute < 24 * 60; ++minute) {
+    uint8_t duty = brightness.dutyAt(midnight + minute * SECS_PER_MIN, location, tzOffset);
+    if (duty == SolarBrightness::DAY_DUTY && previous != duty && times.sunrise < 0) {
+      times.sunrise = minute;
+    }
+    if (duty != SolarBrightness::DAY_DUTY && previous == SolarBrightness::DAY_DUTY && times.sunset < 0) {
+      times.sunset = minute;
+    }
+    times.minDuty = duty < times.minDuty ? duty : times.minDuty;
+    times.maxDuty = duty > times.maxDuty ? duty : times.maxDuty;
+    previous = duty;
+  }
+  return times;
+}
+
+// published times are for the upper limb, the NOAA approximation is good for a few minutes
+void assertSunTimes(const SunTimes &times, int16_t sunrise, int16_t sunset) {
+  TEST_ASSERT_INT_WITHIN(5, sunrise, times.sunrise);
+  TEST_ASSERT_INT_WITHIN(5, sunset, times.sunset);
+  TEST_ASSERT_EQUAL(SolarBrightness::NIGHT_DUTY, times.minDuty);
+  TEST_ASSERT_EQUAL(SolarBrightness::DAY_DUTY, times.maxDuty);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_follows_the_sun() {
+  // 08:04-15:53 GMT
+  assertSunTimes(sunTimesOn(LONDON, 0, 2021, 12, 21), 8 * 60 + 4, 15 * 60 + 53);
+  // 04:43-21:21 BST
+  assertSunTimes(sunTimesOn(LONDON, 3600, 2021, 6, 21), 4 * 60 + 43, 21 * 60 + 21);
+  // 05:25-20:31 EDT
+  assertSunTimes(sunTimesOn(NEW_YORK, -4 * 3600, 2021, 6, 20), 5 * 60 + 25, 20 * 60 + 31);
+  // 05:41-20:05 AEDT
+  assertSunTimes(sunTimesOn(SYDNEY, 11 * 3600, 2021, 12, 21), 5 * 60 + 41, 20 * 60 + 5);
+}
+
+void test_ramps_through_twilight() {
+  SolarBrightness brightness;
+  time_t midnight = daysFromCivil(2021, 12, 21) * SECS_PER_DAY;
+  uint8_t previous = 0;
+  // civil twilight in London starts at 07:24
+  for (int16_t minute = 7 * 60 + 20; minute <= 8 * 60 + 10; ++minute) {
+    uint8_t duty = brightness.dutyAt(midnight + minute * SECS_PER_MIN, LONDON, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(previous, duty);
+    previous = duty;
+  }
+  TEST_ASSERT_EQUAL(SolarBrightness::DAY_DUTY, previous);
+  TEST_ASSERT_EQUAL(SolarBrightness::NIGHT_DUTY, brightness.dutyAt(midnight, LONDON, 0));
+}
+
+void test_stays_dim_through_polar_night() {
+  SunTimes times = sunTimesOn(TROMSO, 3600, 2021, 12, 21);
+  TEST_ASSERT_EQUAL(SolarBrightness::NIGHT_DUTY, times.maxDuty);
+}
+
+void test_stays_lit_through_polar_day() {
+  SunTimes times = sunTimesOn(TROMSO, 2 * 3600, 2021, 6, 21);
+  TEST_ASSERT_EQUAL(SolarBrightness::DAY_DUTY, times.minDuty);
+}
+
+void test_lights_all_without_location() {
+  SolarBrightness brightness;
+  time_t midnight = daysFromCivil(2021, 12, 21) * SECS_PER_DAY;
+  TEST_ASSERT_EQUAL(SolarBrightness::DAY_DUTY, brightness.dutyAt(midnight, INVALID_LOCATION, 0));
+}
+
+void test_recomputes_when_location_or_offset_change() {
+  SolarBrightness brightness;
+  time_t noon = daysFromCivil(2021, 12, 21) * SECS_PER_DAY + 12 * SECS_PER_HOUR;
+  TEST_ASSERT_EQUAL(SolarBrightness::DAY_DUTY, brightness.dutyAt(noon, LONDON, 0));
+  // same minute, same day
+  TEST_ASSERT_EQUAL(SolarBrightness::NIGHT_DUTY, brightness.dutyAt(noon, TROMSO, 3600));
+  TEST_ASSERT_EQUAL(SolarBrightness::DAY_DUTY, brightness.dutyAt(noon, LONDON, 0));
+  // London noon is at midnight of a +12:00 clock
+  TEST_ASSERT_EQUAL(SolarBrightness::NIGHT_DUTY, brightness.dutyAt(noon, LONDON, 12 * 3600));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_follows_the_sun);
+  RUN_TEST(test_ramps_through_twilight);
+  RUN_TEST(test_stays_dim_through_polar_night);
+  RUN_TEST(test_stays_lit_through_polar_day);
+  RUN_TEST(test_lights_all_without_location);
+  RUN_TEST(test_recomputes_when_location_or_offset_change);
+  return UNITY_END();
+}
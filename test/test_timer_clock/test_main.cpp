@@ -0,0 +1,136 @@
+#include <unity.h>
+
+#include "SyncSchedule.h"
+#include "TimerClock.h"
+
+const uint64_t SECOND = 1000000;
+const uint8_t B = TimerClock::BLANK;
+
+void assertFace(uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3, bool dot, const TimerClock::Face &face) {
+  const uint8_t expected[] = {d0, d1, d2, d3};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, face.digits, 4);
+  TEST_ASSERT_EQUAL(dot, face.dot);
+}
+
+// the two digit pairs as numbers
+uint32_t high(const TimerClock::Face &face) {
+  return face.digits[0] * 10 + face.digits[1];
+}
+
+uint32_t low(const TimerClock::Face &face) {
+  return face.digits[2] * 10 + face.digits[3];
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_formats() {
+  TimerClock stopwatch(TimerClock::STOPWATCH, 0, 0);
+  assertFace(0, 0, 0, 0, true, stopwatch.faceAt(0));
+  assertFace(5, 9, 9, 9, true, stopwatch.faceAt(60 * SECOND - 1));
+  assertFace(0, 1, 0, 0, true, stopwatch.faceAt(60 * SECOND));
+  // the dot blinks once a second past a minute
+  assertFace(0, 1, 0, 0, false, stopwatch.faceAt(60 * SECOND + SECOND / 2));
+  assertFace(9, 9, 5, 9, false, stopwatch.faceAt(100 * 60 * SECOND - 1));
+  assertFace(0, 1, 4, 0, true, stopwatch.faceAt(100 * 60 * SECOND));
+  // hours stop at 99
+  assertFace(9, 9, 0, 0, true, stopwatch.faceAt(120 * 3600 * SECOND));
+}
+
+void test_countdown_ends_at_zero() {
+  TimerClock countdown(TimerClock::COUNTDOWN, 30, 1000);
+  assertFace(3, 0, 0, 0, true, countdown.faceAt(1000));
+  // rounded up, the last hundredth still shows 00.01
+  assertFace(0, 0, 0, 1, true, countdown.faceAt(1000 + 30 * SECOND - 1));
+  assertFace(0, 0, 0, 0, true, countdown.faceAt(1000 + 30 * SECOND));
+  assertFace(B, B, B, B, false, countdown.faceAt(1000 + 30 * SECOND + TimerClock::FLASH_PERIOD_MICROS));
+  assertFace(0, 0, 0, 0, true, countdown.faceAt(1000 + 30 * SECOND + 2 * TimerClock::FLASH_PERIOD_MICROS));
+  TEST_ASSERT_FALSE(countdown.isFinished(1000 + 30 * SECOND + TimerClock::FLASH_MICROS - 1));
+  TEST_ASSERT_TRUE(countdown.isFinished(1000 + 30 * SECOND + TimerClock::FLASH_MICROS));
+
+  TimerClock stopwatch(TimerClock::STOPWATCH, 0, 0);
+  TEST_ASSERT_FALSE(stopwatch.isFinished(1000 * 3600 * SECOND));
+}
+
+void test_pause_excludes_paused_time() {
+  TimerClock stopwatch(TimerClock::STOPWATCH, 0, 0);
+  stopwatch.pause(10 * SECOND);
+  assertFace(1, 0, 0, 0, true, stopwatch.faceAt(50 * SECOND));
+  // pausing twice doesn't restart the pause
+  stopwatch.pause(50 * SECOND);
+  stopwatch.resume(70 * SECOND);
+  stopwatch.resume(80 * SECOND);
+  assertFace(2, 0, 5, 0, true, stopwatch.faceAt(80 * SECOND + SECOND / 2));
+
+  TimerClock countdown(TimerClock::COUNTDOWN, 10, 0);
+  countdown.pause(5 * SECOND);
+  TEST_ASSERT_FALSE(countdown.isFinished(3600 * SECOND));
+  assertFace(0, 5, 0, 0, true, countdown.faceAt(3600 * SECOND));
+}
+
+/*
+ * 30 hours on a board whose crystal runs DRIFT_PPM fast, read at jittery
+ * intervals as loop() does, while SyncSchedule steps the wall time back
+ * daily. The timers show the crystal's elapsed time at every read, so they
+ * don't step with the wall time, and their error against true time is the
+ * crystal's drift, not the jitter.
+ */
+const int64_t DRIFT_PPM = 40;
+
+void test_runs_on_the_crystal() {
+  const uint64_t start = 123456789;
+  const time_t startTime = daysFromCivil(2021, 3, 27) * SECS_PER_DAY;
+  TimerClock stopwatch(TimerClock::STOPWATCH, 0, start);
+  TimerClock countdown(TimerClock::COUNTDOWN, 30 * 3600, start);
+  SyncSchedule sync;
+  uint32_t random = 1;
+  uint64_t trueMicros = 0;
+  int32_t maxStep = 0;
+  uint64_t endedAt = 0;
+  while (trueMicros < 30 * 3600 * SECOND) {
+    random = random * 1103515245 + 12345;
+    // 1-50 ms, a delay(50) loop at worst
+    trueMicros += 1000 + random % 49000;
+    uint64_t boardElapsed = trueMicros + trueMicros * DRIFT_PPM / 1000000;
+    uint64_t now = start + boardElapsed;
+    uint32_t boardMillis = now / 1000;
+    if (sync.isSyncTime(boardMillis)) {
+      int32_t step = sync.succeeded(startTime + trueMicros / SECOND, boardMillis);
+      maxStep = step < maxStep ? step : maxStep;
+    }
+
+    TimerClock::Face shown = stopwatch.faceAt(now);
+    TimerClock::Face left = countdown.faceAt(now);
+    // past 100 minutes the stopwatch shows HH:MM, seconds are checked before that
+    if (boardElapsed < 100 * 60 * SECOND) {
+      uint32_t shownSecs = boardElapsed < 60 * SECOND ? high(shown) : high(shown) * 60 + low(shown);
+      TEST_ASSERT_EQUAL_UINT32(boardElapsed / SECOND, shownSecs);
+    } else {
+      TEST_ASSERT_EQUAL_UINT32(boardElapsed / (60 * SECOND), high(shown) * 60 + low(shown));
+    }
+    if (boardElapsed + 100 * 60 * SECOND <= 30 * 3600 * SECOND) {
+      uint64_t remaining = 30 * 3600 * SECOND - boardElapsed;
+      TEST_ASSERT_EQUAL_UINT32((remaining + 9999) / 10000 / 6000, high(left) * 60 + low(left));
+    }
+    if (!endedAt && boardElapsed >= 30 * 3600 * SECOND) {
+      assertFace(0, 0, 0, 0, true, left);
+      endedAt = trueMicros;
+    }
+  }
+  // the wall time was stepped back by the drift of a day, about 3.5 s
+  TEST_ASSERT_INT_WITHIN(1, -int32_t(SECS_PER_DAY * DRIFT_PPM / 1000000), maxStep);
+
+  // the countdown ended early by the crystal's drift, 4.32 s in 30 hours, give or take a read
+  TEST_ASSERT_TRUE(endedAt);
+  TEST_ASSERT_UINT_WITHIN(50000, 30 * 3600 * SECOND * DRIFT_PPM / 1000000, 30 * 3600 * SECOND - endedAt);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_formats);
+  RUN_TEST(test_countdown_ends_at_zero);
+  RUN_TEST(test_pause_excludes_paused_time);
+  RUN_TEST(test_runs_on_the_crystal);
+  return UNITY_END();
+}
@@ -0,0 +1,30 @@
+#include <initializer_list>
+#include <unity.h>
+
+#include "WebAssets.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_serves_portal_assets() {
+  for (const char *path : {"/", "/index.htm", "/chota.css", "/jquery.js", "/index.htm.gz", "/favicon.ico"}) {
+    TEST_ASSERT_TRUE_MESSAGE(isWebAsset(path), path);
+  }
+}
+
+// AssetGuard answers 404 to whatever isn't an asset, before serveStatic() gets it
+void test_refuses_settings_and_other_files() {
+  for (const char *path : {"/config.cfg", "/networks.cfg", "/schedule.cfg", "/config.cfg.gz",
+                           "/index.htm.new", "/startup.nxa", "/rainbow.fx", "/.htm", "/.htm.gz",
+                           "/sub/index.htm", "config.cfg", "", "/index.html", "/index.htm/"}) {
+    TEST_ASSERT_FALSE_MESSAGE(isWebAsset(path), path);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_serves_portal_assets);
+  RUN_TEST(test_refuses_settings_and_other_files);
+  return UNITY_END();
+}
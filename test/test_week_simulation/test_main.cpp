@@ -0,0 +1,288 @@
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <unity.h>
+
+#include "FlashStore.h"
+#include "MessageQueue.h"
+#include "RadioPower.h"
+#include "Scheduler.h"
+#include "SolarBrightness.h"
+#include "SyncSchedule.h"
+#include "TimerClock.h"
+
+/*
+ * A week of the clock in virtual time, driving the modules the way
+ * ClocksBehavior::doLoop() does, a loop every 50 ms as the idle clock
+ * delays, over the night Berlin switches to summer time. The board's
+ * crystal runs fast and the clock syncs daily, some syncs fail as Wi-Fi
+ * drops, and the tz offset, taken from the timezone API, changes only with
+ * a sync, so local time steps. The radio is managed by RadioPower and the
+ * settings files go through FlashStore, into RAM. Everything random comes
+ * from SEED, so a run is reproducible and its metrics can be tracked.
+ */
+const uint32_t SEED = 2021;
+const time_t START = daysFromCivil(2021, 3, 24) * SECS_PER_DAY;
+const uint8_t DAYS = 7;
+const uint32_t LOOP_MILLIS = 50;
+const int32_t DRIFT_PPM = 40;
+// one in five syncs fails
+const uint8_t SYNC_FAILURE_ODDS = 5;
+const Location BERLIN = {52.5200, 13.4050};
+// 2021-03-28 01:00 UTC
+const time_t SUMMER_TIME = daysFromCivil(2021, 3, 28) * SECS_PER_DAY + SECS_PER_HOUR;
+
+int32_t berlinOffset(time_t utc) {
+  return utc < SUMMER_TIME ? SECS_PER_HOUR : 2 * SECS_PER_HOUR;
+}
+
+uint32_t nextRandom(uint32_t &random) {
+  random = random * 1103515245 + 12345;
+  return random >> 8;
+}
+
+// the board's millis, shared by the modules' adapters
+uint32_t boardNow = 0;
+
+struct SimRadio {
+  uint32_t millis() const {
+    return boardNow;
+  }
+
+  void setSleep(RadioSleep) {}
+};
+
+struct SimFile {
+  std::string *content;
+
+  explicit operator bool() const {
+    return content;
+  }
+
+  std::string readString() const {
+    return *content;
+  }
+
+  size_t print(const std::string &data) {
+    content->append(data);
+    return data.length();
+  }
+
+  void close() {}
+};
+
+struct SimStorage {
+  typedef SimFile File;
+  typedef std::string Content;
+
+  std::map<std::string, std::string> &files;
+
+  File open(const char *path, const char *mode) {
+    if (*mode == 'w') {
+      std::string &content = files[path];
+      content.clear();
+      return {&content};
+    }
+    auto file = files.find(path);
+    return {file != files.end() ? &file->second : nullptr};
+  }
+
+  size_t blockSize() const {
+    return 4096;
+  }
+
+  uint32_t millis() const {
+    return boardNow;
+  }
+};
+
+const char NETWORKS_FILE[] = "/networks.cfg";
+const char SCHEDULE_FILE[] = "/schedule.cfg";
+const char CONFIG_FILE[] = "/config.cfg";
+
+struct Simulation {
+  // what Metrics would report
+  uint32_t syncs = 0;
+  uint32_t syncFailures = 0;
+  int32_t maxDisplayErrorSecs = 0;
+  uint32_t fired[3] = {};
+  uint32_t nightMinutes = 0;
+  uint32_t brightnessChanges = 0;
+  uint32_t maxTopLatencyMillis = 0;
+  uint64_t timerMicros = 0;
+  MessageStats messages = {};
+  RadioStats radio = {};
+  uint32_t flashWrites = 0;
+  uint32_t flashBytesWritten = 0;
+};
+
+Simulation simulate() {
+  Simulation sim;
+  Scheduler scheduler;
+  Scheduler::Rule alarm = {0x3E, 7, 0, Scheduler::ACTION_ANIMATION, "alarm"};
+  Scheduler::Rule chime = {0x7F, Scheduler::EVERY_HOUR, 0, Scheduler::ACTION_ANIMATION, "chime"};
+  Scheduler::Rule cleaning = {0x7F, 3, 30, Scheduler::ACTION_CATHODE_CLEANING, ""};
+  scheduler.add(alarm);
+  scheduler.add(chime);
+  scheduler.add(cleaning);
+  SolarBrightness brightness;
+  MessageQueue queue(sim.messages);
+  TimerClock *timer = nullptr;
+  TimerClock timerClock(TimerClock::COUNTDOWN, 25 * SECS_PER_MIN, 0);
+
+  SyncSchedule sync;
+  boardNow = 0;
+  RadioPower<SimRadio> radio(SimRadio(), sim.radio);
+  std::map<std::string, std::string> files = {{CONFIG_FILE, "home\nauto\n"}};
+  FlashStore<SimStorage> flashStore(SimStorage{files});
+  flashStore.begin();
+  // as init() does: the hints of the network found, the schedule
+  flashStore.write(NETWORKS_FILE, "home\nsecret\n0\n-61,6,a0b1c2d3e4f5\n", true);
+  flashStore.write(SCHEDULE_FILE, "62,7,0,0,alarm\n127,255,0,0,chime\n127,3,30,2,\n");
+
+  uint32_t random = SEED;
+  int32_t tzOffset = 0;
+  uint8_t duty = 0;
+  uint64_t topEnqueuedAt = 0;
+  bool topPending = false;
+  int16_t shown = -1;
+  uint64_t timerStartedAt = 0;
+
+  for (uint64_t ms = 0; ms < DAYS * SECS_PER_DAY * 1000ull; ms += LOOP_MILLIS) {
+    time_t utc = START + ms / 1000;
+    uint64_t boardMillis = ms + ms * DRIFT_PPM / 1000000;
+    boardNow = boardMillis;
+    radio.setNeeded(RADIO_SYNC, sync.isSyncDue(boardNow));
+    radio.sample();
+    // a client of the management server now and then, idle otherwise
+    radio.setNeeded(RADIO_MANAGEMENT, true, ms % (3 * 3600000) < 5000);
+    if (sync.isSyncTime(boardNow)) {
+      if (sync.isSynced() && nextRandom(random) % SYNC_FAILURE_ODDS == 0) {
+        sync.failed(boardNow);
+        ++sim.syncFailures;
+      } else {
+        int32_t error = sync.succeeded(utc, boardNow);
+        error = error < 0 ? -error : error;
+        sim.maxDisplayErrorSecs = error > sim.maxDisplayErrorSecs ? error : sim.maxDisplayErrorSecs;
+        ++sim.syncs;
+        tzOffset = berlinOffset(utc);
+      }
+    }
+    time_t localTime = sync.timeAt(boardNow) + tzOffset;
+    // the settings page saved daily, unchanged but for one tz change
+    if (ms % (SECS_PER_DAY * 1000ull) == 12 * 3600000ull) {
+      flashStore.write(CONFIG_FILE, ms < 3 * SECS_PER_DAY * 1000ull ? "home\nauto\n" : "home\n+0100\n");
+    }
+    flashStore.doLoop();
+
+    uint8_t newDuty = brightness.dutyAt(localTime, BERLIN, tzOffset);
+    sim.brightnessChanges += newDuty != duty;
+    duty = newDuty;
+    if (ms % 60000 == 0 && duty == SolarBrightness::NIGHT_DUTY) {
+      ++sim.nightMinutes;
+    }
+
+    for (int8_t rule; (rule = scheduler.due(localTime)) >= 0;) {
+      ++sim.fired[rule];
+    }
+
+    // a message every 10 minutes on average, a top priority one at a time
+    if (nextRandom(random) % (10 * 60 * 1000 / LOOP_MILLIS) == 0) {
+      bool top = !topPending && nextRandom(random) % 4 == 0;
+      uint32_t showSecs = 1 + nextRandom(random) % (MessageQueue::MAX_SHOW_MILLIS / 1000);
+      if (queue.push(top ? 9999 : nextRandom(random) % 9999, top ? 255 : nextRandom(random) % 255,
+                     MessageQueue::DEFAULT_TTL_SECS * 1000, showSecs * 1000, boardMillis)) {
+        topEnqueuedAt = top ? boardMillis : topEnqueuedAt;
+        topPending |= top;
+      }
+    }
+    int16_t message = queue.doLoop(boardMillis);
+    if (message == 9999 && shown != 9999) {
+      uint32_t latency = boardMillis - topEnqueuedAt;
+      sim.maxTopLatencyMillis = latency > sim.maxTopLatencyMillis ? latency : sim.maxTopLatencyMillis;
+      topPending = false;
+    }
+    shown = message;
+
+    // a countdown started over the local time step of summer time
+    uint64_t boardMicros = boardMillis * 1000;
+    if (!timer && !timerStartedAt && utc >= SUMMER_TIME - 10 * SECS_PER_MIN) {
+      timerClock = TimerClock(TimerClock::COUNTDOWN, 25 * SECS_PER_MIN, boardMicros);
+      timer = &timerClock;
+      timerStartedAt = boardMicros;
+    }
+    if (timer && timer->isFinished(boardMicros)) {
+      sim.timerMicros = boardMicros - timerStartedAt;
+      timer = nullptr;
+    }
+  }
+  radio.sample();
+  flashStore.totals(sim.flashWrites, sim.flashBytesWritten);
+  return sim;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_week() {
+  auto startedAt = std::chrono::steady_clock::now();
+  Simulation sim = simulate();
+  long wallMillis = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - startedAt).count();
+  // a line to track across commits
+  printf("{\"seed\": %u, \"days\": %u, \"syncs\": %u, \"sync-failures\": %u, \"display-error-secs\": %d, "
+         "\"alarms\": %u, \"chimes\": %u, \"cleanings\": %u, \"night-minutes\": %u, \"brightness-changes\": %u, "
+         "\"messages-shown\": %u, \"messages-expired\": %u, \"messages-dropped\": %u, "
+         "\"top-message-max-latency-ms\": %u, \"flash-writes\": %u, \"flash-bytes-written\": %u, "
+         "\"radio-awake-secs\": %u, \"energy-mah\": %.1f, \"wall-ms\": %ld}\n",
+         SEED, DAYS, sim.syncs, sim.syncFailures, sim.maxDisplayErrorSecs,
+         sim.fired[0], sim.fired[1], sim.fired[2], sim.nightMinutes, sim.brightnessChanges,
+         sim.messages.shown, sim.messages.expired, sim.messages.dropped, sim.maxTopLatencyMillis,
+         sim.flashWrites, sim.flashBytesWritten, sim.radio.sleepMillis[RADIO_AWAKE] / 1000,
+         sim.radio.energyEstimate(), wallMillis);
+
+  TEST_ASSERT_EQUAL(DAYS + 1, sim.syncs + sim.syncFailures);
+  // 40 ppm is 3.5 s a day, up to a few days between syncs
+  TEST_ASSERT_LESS_OR_EQUAL(int32_t(4 * (sim.syncFailures + 1)), sim.maxDisplayErrorSecs);
+  // Wednesday to Tuesday, weekdays only
+  TEST_ASSERT_EQUAL(5, sim.fired[0]);
+  // local time covers an hour more as summer time starts, the chime of the
+  // skipped hour rings at the step rather than being lost
+  TEST_ASSERT_EQUAL(DAYS * 24 + 1, sim.fired[1]);
+  TEST_ASSERT_EQUAL(DAYS, sim.fired[2]);
+  // Berlin's nights are 11-12 hours in late March, the twilight ramps aside
+  TEST_ASSERT_INT_WITHIN(DAYS * 60, DAYS * 10 * 60, sim.nightMinutes);
+  TEST_ASSERT_GREATER_OR_EQUAL(2 * DAYS, sim.brightnessChanges);
+  TEST_ASSERT_GREATER_THAN(0, sim.messages.shown);
+  TEST_ASSERT_LESS_OR_EQUAL(MessageQueue::MAX_SHOW_MILLIS + MessageQueue::GAP_MILLIS + LOOP_MILLIS,
+                            sim.maxTopLatencyMillis);
+  // a countdown runs by the board's micros, local time steps don't touch it
+  const uint32_t timerMillis = (25 * SECS_PER_MIN * 1000000ull + TimerClock::FLASH_MICROS) / 1000;
+  TEST_ASSERT_GREATER_OR_EQUAL(timerMillis, uint32_t(sim.timerMicros / 1000));
+  TEST_ASSERT_LESS_THAN(timerMillis + LOOP_MILLIS, uint32_t(sim.timerMicros / 1000));
+  // the hints, the schedule and the one tz change, the other saves change nothing
+  TEST_ASSERT_EQUAL(3, sim.flashWrites);
+  // awake a minute ahead of each daily sync and while a client is served
+  uint32_t awakeSecs = SyncSchedule::WAKE_AHEAD_MILLIS / 1000 * DAYS + DAYS * 8 * 5;
+  TEST_ASSERT_UINT_WITHIN(DAYS * 8, awakeSecs, sim.radio.sleepMillis[RADIO_AWAKE] / 1000);
+}
+
+// the same seed, the same week
+void test_is_deterministic() {
+  Simulation a = simulate();
+  Simulation b = simulate();
+  TEST_ASSERT_EQUAL(a.syncFailures, b.syncFailures);
+  TEST_ASSERT_EQUAL(a.brightnessChanges, b.brightnessChanges);
+  TEST_ASSERT_EQUAL(a.messages.shown, b.messages.shown);
+  TEST_ASSERT_EQUAL(a.maxTopLatencyMillis, b.maxTopLatencyMillis);
+  TEST_ASSERT_EQUAL(a.radio.sleepMillis[RADIO_AWAKE], b.radio.sleepMillis[RADIO_AWAKE]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_week);
+  RUN_TEST(test_is_deterministic);
+  return UNITY_END();
+}